@@ -0,0 +1,173 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// Startup cost of the font atlas: cold build of the embedded fonts vs restore from the atlas cache.
+// Each embedded font is added as main.cpp preloads it: default and large sizes, icons merged, whole BMP.
+
+// project
+#include <view/font.hpp>
+#include <view/font_cache.hpp>
+
+// external
+#include <IconsFontAwesome6.h>
+#include <compiled_fonts.h>
+#include <fmt/format.h>
+#include <imgui.h>
+
+// C++ standard
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+    // as font.cpp builds the atlas
+    constexpr ImWchar ALL_GLYPHS_RANGES[] = {0x0001, 0xFFFF, 0};
+    constexpr ImWchar ICONS_RANGES[] = {ICON_MIN_FA, ICON_MAX_16_FA, 0};
+    constexpr float ICONS_SCALE = 0.9f;
+    constexpr float SIZES[] = {font::DEFAULT_FONT_SIZE, font::LARGE_FONT_SIZE};
+    constexpr uint64_t CACHE_KEY = 0x42454E43484D524B;
+
+    struct embedded_font
+    {
+        std::string_view name;
+        const unsigned int* data;
+        unsigned int size;
+    };
+
+    const embedded_font FONTS[] = {
+      {"DroidSansMono", DroidSansMono_compressed_data, DroidSansMono_compressed_size},
+      {"IntelOneMono", IntelOneMono_compressed_data, IntelOneMono_compressed_size},
+      {"NotoSansMono", NotoSansMono_compressed_data, NotoSansMono_compressed_size},
+      {"RobotoMono", RobotoMono_compressed_data, RobotoMono_compressed_size},
+      {"Cousine", Cousine_compressed_data, Cousine_compressed_size},
+      {"SourceCodePro", SourceCodePro_compressed_data, SourceCodePro_compressed_size},
+    };
+
+    // a restored atlas doesn't read the font data, as font.cpp add_font()
+    ImFont* add_font(ImFontAtlas& atlas, const unsigned int* data, unsigned int size, ImFontConfig config, bool cached)
+    {
+        if(!cached)
+        {
+            return atlas.AddFontFromMemoryCompressedTTF(
+              data, static_cast<int>(size), config.SizePixels, &config, config.GlyphRanges);
+        }
+        static constexpr unsigned char placeholder = 0;
+        config.FontData = const_cast<unsigned char*>(&placeholder);
+        config.FontDataSize = 1;
+        config.FontDataOwnedByAtlas = false;
+        return atlas.AddFont(&config);
+    }
+
+    void add_fonts(ImFontAtlas& atlas, const embedded_font& font, bool cached)
+    {
+        for(const float size: SIZES)
+        {
+            ImFontConfig font_config;
+            font_config.SizePixels = size;
+            font_config.GlyphRanges = ALL_GLYPHS_RANGES;
+            add_font(atlas, font.data, font.size, font_config, cached);
+
+            ImFontConfig icons_config;
+            icons_config.SizePixels = size * ICONS_SCALE;
+            icons_config.GlyphRanges = ICONS_RANGES;
+            icons_config.MergeMode = true;
+            icons_config.PixelSnapH = true;
+            icons_config.GlyphMinAdvanceX = size;
+            add_font(
+              atlas, FontAwesome6_solid_compressed_data, FontAwesome6_solid_compressed_size, icons_config, cached);
+        }
+    }
+
+    template<typename Func>
+    [[nodiscard]] double time_ms(Func&& func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    [[nodiscard]] double median(std::vector<double> values)
+    {
+        std::ranges::sort(values);
+        return values[values.size() / 2];
+    }
+} // namespace
+
+// usage: font_atlas_benchmark [runs]
+int main(int argc, char* argv[])
+{
+    int runs = 5;
+    if(argc > 1)
+    {
+        const std::string_view arg = argv[1];
+        if(std::from_chars(arg.data(), arg.data() + arg.size(), runs).ec != std::errc{} || runs <= 0)
+        {
+            fmt::print(stderr, "invalid runs count: {}\n", arg);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::filesystem::path cache_path = std::filesystem::temp_directory_path() / "font_atlas_benchmark.atlas";
+    fmt::print("{:<16}{:>12}{:>14}{:>16}{:>10}\n", "font", "atlas", "build (ms)", "restore (ms)", "speedup");
+    for(const embedded_font& font: FONTS)
+    {
+        std::vector<double> builds;
+        std::vector<double> restores;
+        int width = 0;
+        int height = 0;
+        for(int run = 0; run < runs; ++run)
+        {
+            // fonts adding included, as font.cpp run_build() times it
+            ImFontAtlas built;
+            builds.push_back(time_ms([&] {
+                add_fonts(built, font, false);
+                built.Build();
+            }));
+            width = built.TexWidth;
+            height = built.TexHeight;
+            if(tl::expected<void, std::string> res = font_cache::save(built, cache_path, CACHE_KEY); !res)
+            {
+                fmt::print(stderr, "failed to cache {} atlas: {}\n", font.name, res.error());
+                return EXIT_FAILURE;
+            }
+
+            ImFontAtlas restored;
+            tl::expected<void, std::string> res;
+            restores.push_back(time_ms([&] {
+                add_fonts(restored, font, true);
+                res = font_cache::load(restored, cache_path, CACHE_KEY);
+            }));
+            if(!res)
+            {
+                fmt::print(stderr, "failed to restore {} atlas: {}\n", font.name, res.error());
+                return EXIT_FAILURE;
+            }
+        }
+
+        const double build_ms = median(std::move(builds));
+        const double restore_ms = median(std::move(restores));
+        fmt::print("{:<16}{:>12}{:>14.1f}{:>16.1f}{:>9.1f}x\n",
+                   font.name,
+                   fmt::format("{}x{}", width, height),
+                   build_ms,
+                   restore_ms,
+                   build_ms / restore_ms);
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove(cache_path, ignored);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// Cost of getting a logger: get_logger, a registry lookup under its lock on every call, vs the cached static_logger.
+// filtered: a debug log below the logger level, where getting the logger is the whole cost of the call.
+// contended: the same lookups from every thread at once, the registry lock is shared.
+
+// project
+#include <utils/log.hpp>
+
+// external
+#include <fmt/format.h>
+#include <spdlog/sinks/null_sink.h>
+#include <spdlog/spdlog.h>
+
+// C++ standard
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t CALLS = 1'000'000;
+    // about as many loggers as the application registers
+    constexpr size_t REGISTERED_LOGGERS = 16;
+
+    std::atomic<uint64_t> sink = 0;
+
+    void lookup() noexcept
+    {
+        const std::shared_ptr<spdlog::logger> logger = logging::get_logger("font");
+        sink.fetch_add(static_cast<uint64_t>(logger->level()), std::memory_order_relaxed);
+    }
+
+    void cached() noexcept
+    {
+        const std::shared_ptr<spdlog::logger>& logger = logging::static_logger<"font">();
+        sink.fetch_add(static_cast<uint64_t>(logger->level()), std::memory_order_relaxed);
+    }
+
+    void filtered_lookup() noexcept
+    {
+        SPDLOG_LOGGER_DEBUG(logging::get_logger("font"), "filtered {}", CALLS);
+    }
+
+    void filtered_cached() noexcept
+    {
+        SPDLOG_LOGGER_DEBUG(logging::static_logger<"font">(), "filtered {}", CALLS);
+    }
+
+    // the loggers log nowhere: only getting them is measured
+    void register_loggers()
+    {
+        for(size_t i = 0; i < REGISTERED_LOGGERS; ++i)
+        {
+            const std::string name = i == 0 ? std::string("font") : fmt::format("logger{}", i);
+            auto logger = std::make_shared<spdlog::logger>(name, std::make_shared<spdlog::sinks::null_sink_mt>());
+            logger->set_level(spdlog::level::info);
+            spdlog::register_logger(std::move(logger));
+        }
+    }
+
+    template<typename Func>
+    [[nodiscard]] double time_ms(Func&& func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    [[nodiscard]] double median(std::vector<double> values)
+    {
+        std::ranges::sort(values);
+        return values[values.size() / 2];
+    }
+
+    // CALLS calls split over threads, nanoseconds per call
+    [[nodiscard]] double run(size_t threads, int runs, void (*call)())
+    {
+        const auto calls = [call, threads]()
+        {
+            std::vector<std::jthread> workers;
+            for(size_t t = 0; t < threads; ++t)
+            {
+                workers.emplace_back(
+                  [call, threads]()
+                  {
+                      for(size_t i = 0; i < CALLS / threads; ++i)
+                      {
+                          call();
+                      }
+                  });
+            }
+        };
+        calls();
+        std::vector<double> times;
+        for(int i = 0; i < runs; ++i)
+        {
+            times.push_back(time_ms(calls));
+        }
+        return median(std::move(times)) * 1'000'000 / CALLS;
+    }
+
+    [[nodiscard]] bool parse(std::string_view arg, int& value)
+    {
+        return std::from_chars(arg.data(), arg.data() + arg.size(), value).ec == std::errc{} && value > 0;
+    }
+} // namespace
+
+// usage: logger_lookup_benchmark [runs] [threads]
+int main(int argc, char* argv[])
+{
+    int runs = 5;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if(argc > 1 && !parse(argv[1], runs))
+    {
+        fmt::print(stderr, "invalid runs count: {}\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if(argc > 2 && !parse(argv[2], threads))
+    {
+        fmt::print(stderr, "invalid threads count: {}\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    register_loggers();
+
+    struct scenario
+    {
+        std::string_view name;
+        void (*lookup)();
+        void (*cached)();
+        size_t threads;
+    };
+    const scenario scenarios[] = {
+      {"get", &lookup, &cached, 1},
+      {"filtered", &filtered_lookup, &filtered_cached, 1},
+      {"contended", &lookup, &cached, static_cast<size_t>(threads)},
+    };
+
+    fmt::print("{} calls, {} threads when contended, median of {} runs\n", CALLS, threads, runs);
+    fmt::print("{:<11}{:>18}{:>21}{:>10}\n", "scenario", "get_logger (ns)", "static_logger (ns)", "speedup");
+    for(const scenario& s: scenarios)
+    {
+        const double lookup_ns = run(s.threads, runs, s.lookup);
+        const double cached_ns = run(s.threads, runs, s.cached);
+        fmt::print("{:<11}{:>18.1f}{:>21.1f}{:>9.1f}x\n", s.name, lookup_ns, cached_ns, lookup_ns / cached_ns);
+    }
+    return EXIT_SUCCESS;
+}
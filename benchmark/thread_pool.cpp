@@ -0,0 +1,152 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// Contention of the thread pool scheduling: the single shared queue, as before work stealing, vs per-worker deques.
+// fan-out: small tasks pushed from outside the pool, spread over the queues.
+// nested: root tasks pushing their children from the workers, which stay local and are stolen by idle workers.
+
+// project
+#include <utils/thread_pool.hpp>
+
+// external
+#include <fmt/format.h>
+
+// C++ standard
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t FAN_OUT_TASKS = 200'000;
+    constexpr size_t NESTED_ROOTS = 64;
+    constexpr size_t NESTED_CHILDREN = 4'096;
+    constexpr size_t TASK_WORK = 64;
+
+    std::atomic<uint64_t> sink = 0;
+
+    // a few hundred nanoseconds of work, so the queues are what gets measured
+    void small_work(uint64_t seed) noexcept
+    {
+        uint64_t value = seed;
+        for(size_t i = 0; i < TASK_WORK; ++i)
+        {
+            value = value * 6364136223846793005ull + 1442695040888963407ull;
+        }
+        sink.fetch_add(value & 1, std::memory_order_relaxed);
+    }
+
+    void fan_out(thread_pool& pool)
+    {
+        for(size_t i = 0; i < FAN_OUT_TASKS; ++i)
+        {
+            pool.exec([i]() noexcept { small_work(i); });
+        }
+        pool.wait();
+    }
+
+    void nested(thread_pool& pool)
+    {
+        for(size_t root = 0; root < NESTED_ROOTS; ++root)
+        {
+            pool.exec(
+              [&pool, root]() noexcept
+              {
+                  for(size_t i = 0; i < NESTED_CHILDREN; ++i)
+                  {
+                      pool.exec([seed = root * NESTED_CHILDREN + i]() noexcept { small_work(seed); });
+                  }
+              });
+        }
+        pool.wait();
+    }
+
+    template<typename Func>
+    [[nodiscard]] double time_ms(Func&& func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    [[nodiscard]] double median(std::vector<double> values)
+    {
+        std::ranges::sort(values);
+        return values[values.size() / 2];
+    }
+
+    [[nodiscard]] double run(thread_pool::scheduling mode, size_t threads, int runs, void (*scenario)(thread_pool&))
+    {
+        thread_pool pool(threads, mode, 0);
+        // warm up the queues, so their growth isn't measured
+        scenario(pool);
+        std::vector<double> times;
+        for(int i = 0; i < runs; ++i)
+        {
+            times.push_back(time_ms([&] { scenario(pool); }));
+        }
+        return median(std::move(times));
+    }
+
+    [[nodiscard]] bool parse(std::string_view arg, int& value)
+    {
+        return std::from_chars(arg.data(), arg.data() + arg.size(), value).ec == std::errc{} && value > 0;
+    }
+} // namespace
+
+// usage: thread_pool_benchmark [runs] [threads]
+int main(int argc, char* argv[])
+{
+    int runs = 5;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if(argc > 1 && !parse(argv[1], runs))
+    {
+        fmt::print(stderr, "invalid runs count: {}\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if(argc > 2 && !parse(argv[2], threads))
+    {
+        fmt::print(stderr, "invalid threads count: {}\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    struct scenario
+    {
+        std::string_view name;
+        void (*func)(thread_pool&);
+        size_t tasks;
+    };
+    const scenario scenarios[] = {
+      {"fan-out", &fan_out, FAN_OUT_TASKS},
+      {"nested", &nested, NESTED_ROOTS * (NESTED_CHILDREN + 1)},
+    };
+
+    fmt::print("{} threads, median of {} runs\n", threads, runs);
+    fmt::print(
+      "{:<10}{:>10}{:>18}{:>20}{:>10}\n", "scenario", "tasks", "single queue (ms)", "work stealing (ms)", "speedup");
+    for(const scenario& s: scenarios)
+    {
+        const auto thread_count = static_cast<size_t>(threads);
+        const double single_ms = run(thread_pool::scheduling::single_queue, thread_count, runs, s.func);
+        const double stealing_ms = run(thread_pool::scheduling::work_stealing, thread_count, runs, s.func);
+        fmt::print("{:<10}{:>10}{:>18.1f}{:>20.1f}{:>9.2f}x\n",
+                   s.name,
+                   s.tasks,
+                   single_ms,
+                   stealing_ms,
+                   single_ms / stealing_ms);
+    }
+    return EXIT_SUCCESS;
+}
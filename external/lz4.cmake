@@ -0,0 +1,43 @@
+#
+# Copyright (c) 2024 Maxime Pinard
+#
+# Distributed under the MIT license
+# See accompanying file LICENSE or copy at
+# https://opensource.org/licenses/MIT
+#
+
+# Fix for CMake pre 3.20 behaviour, see CMP0118
+set_source_files_properties(${global_generated_files_list} PROPERTIES GENERATED ON)
+
+if(TARGET lz4::lz4)
+    return()
+endif()
+
+message(CHECK_START "external: configuring lz4")
+list(APPEND CMAKE_MESSAGE_INDENT "  ")
+
+# Download
+FetchContent_Populate(
+  lz4
+  GIT_REPOSITORY "https://github.com/lz4/lz4"
+  GIT_TAG "v1.10.0"
+  GIT_SHALLOW ON
+  GIT_PROGRESS ON
+)
+
+# Declare lz4, only the block format is used
+add_library(lz4 STATIC)
+add_library(lz4::lz4 ALIAS lz4)
+target_sources(
+  lz4 PRIVATE
+  "${lz4_SOURCE_DIR}/lib/lz4.c"
+  "${lz4_SOURCE_DIR}/lib/lz4.h"
+)
+target_include_directories(
+  lz4 SYSTEM PUBLIC
+  "${lz4_SOURCE_DIR}/lib"
+)
+set_target_properties(lz4 PROPERTIES FOLDER external)
+
+list(POP_BACK CMAKE_MESSAGE_INDENT)
+message(CHECK_PASS "done")
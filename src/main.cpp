@@ -17,6 +17,7 @@
 #include <utils/config.hpp>
 #include <utils/log.hpp>
 #include <utils/thread_pool.hpp>
+#include <utils/ui_dispatcher.hpp>
 #include <version_info.hpp>
 #include <view/components/IconsFinder.hpp>
 #include <view/components/ImSpinnerDemo.hpp>
@@ -64,6 +65,10 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
     {
         return EXIT_FAILURE;
     }
+    SCOPE_EXIT
+    {
+        logging::shutdown();
+    };
     std::shared_ptr<spdlog::logger> logger = logging::get_logger();
 
     const std::string settings_path = config::get_settings_path();
@@ -105,37 +110,53 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
         return EXIT_FAILURE;
     }
 
-    // Preload fonts (first will become the default)
-    font::preload(font::embedded::DROID_SANS_MONO, font::DEFAULT_FONT_SIZE);
-    font::preload(font::embedded::DROID_SANS_MONO, font::LARGE_FONT_SIZE);
-
-    // font::preload(font::embedded::INTEL_ONE_MONO, font::DEFAULT_FONT_SIZE);
-    // font::preload(font::embedded::INTEL_ONE_MONO, font::LARGE_FONT_SIZE);
-
-    // font::preload(font::embedded::NOTO_SANS_MONO, font::DEFAULT_FONT_SIZE);
-    // font::preload(font::embedded::NOTO_SANS_MONO, font::LARGE_FONT_SIZE);
-
-    // font::preload(font::embedded::ROBOTO_MONO, font::DEFAULT_FONT_SIZE);
-    // font::preload(font::embedded::ROBOTO_MONO, font::LARGE_FONT_SIZE);
-
-    // font::preload(font::embedded::COUSINE, font::DEFAULT_FONT_SIZE);
-    // font::preload(font::embedded::COUSINE, font::LARGE_FONT_SIZE);
-
-    // font::preload(font::embedded::SOURCE_CODE_PRO, font::DEFAULT_FONT_SIZE);
-    // font::preload(font::embedded::SOURCE_CODE_PRO, font::LARGE_FONT_SIZE);
-
     // State variables
     bool show_imgui_demo_window = true;
     bool show_implot_demo_window = true;
     bool show_another_window = false;
+    bool sdf_fonts = false;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
     //    ImPlotTime t;
     //    ImPlotTime default_time = ImPlot::MakeTime(2024, 1, 1);
     //    ImPlotTime min_time = ImPlot::MakeTime(2023, 1, 1);
     //    ImPlotTime max_time = ImPop::LocTimeNow();
 
+    // background tasks
+    static constexpr std::chrono::milliseconds UI_DISPATCH_BUDGET{2};
+    thread_pool tp(8, thread_pool::scheduling::work_stealing, 2);
+    STORED_LOGS->compress_cold_segments(&tp);
+    SCOPE_EXIT
+    {
+        STORED_LOGS->compress_cold_segments(nullptr);
+    };
+
+    // Preload fonts (first will become the default)
+    // built in background when not cached: the first frames use the ImGui default font until then
+    font::set_build_pool(&tp);
+    SCOPE_EXIT
+    {
+        font::set_build_pool(nullptr);
+    };
+    font::preload_batch({
+      {font::embedded::DROID_SANS_MONO, font::DEFAULT_FONT_SIZE},
+      {font::embedded::DROID_SANS_MONO, font::LARGE_FONT_SIZE},
+      // {font::embedded::INTEL_ONE_MONO, font::DEFAULT_FONT_SIZE},
+      // {font::embedded::INTEL_ONE_MONO, font::LARGE_FONT_SIZE},
+      // {font::embedded::NOTO_SANS_MONO, font::DEFAULT_FONT_SIZE},
+      // {font::embedded::NOTO_SANS_MONO, font::LARGE_FONT_SIZE},
+      // {font::embedded::ROBOTO_MONO, font::DEFAULT_FONT_SIZE},
+      // {font::embedded::ROBOTO_MONO, font::LARGE_FONT_SIZE},
+      // {font::embedded::COUSINE, font::DEFAULT_FONT_SIZE},
+      // {font::embedded::COUSINE, font::LARGE_FONT_SIZE},
+      // {font::embedded::SOURCE_CODE_PRO, font::DEFAULT_FONT_SIZE},
+      // {font::embedded::SOURCE_CODE_PRO, font::LARGE_FONT_SIZE},
+    });
+
+    std::optional<std::string> test;
+    task_handle<std::string> test_task;
+
     // Log viewer
-    Window<LogViewer> log_viewer("Logs");
+    Window<LogViewer> log_viewer("Logs", tp);
 
     // Text editor style editor
     Window<TextEditorStyleEditor> text_editor_style_editor("Text editor style", style::color::text_editor::palette);
@@ -159,17 +180,18 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
     // Icons finder
     Window<IconsFinder> icons_finder("Icons finder");
 
-    // background tasks
-    thread_pool tp(8);
-    std::optional<std::string> test;
-    std::future<std::string> test_future;
-
     // Main loop
     while(!glfwWindowShouldClose(main_window_handle->glf_window))
     {
         // Process events
         glfwPollEvents();
 
+        // Deliver background results
+        UI_DISPATCHER.drain(UI_DISPATCH_BUDGET);
+
+        // Apply the fonts, glyphs and rendering requested during the last frame
+        font::new_frame();
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -272,6 +294,10 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
                             SPDLOG_LOGGER_DEBUG(logger, "Hide logs console");
                         }
                     }
+                    if(ImGui::MenuItem(ICON_FA_FONT " SDF fonts", nullptr, &sdf_fonts))
+                    {
+                        font::set_rendering(sdf_fonts ? font::rendering::SDF : font::rendering::BITMAP);
+                    }
                     ImGui::EndMenu();
                 }
                 if(ImGui::BeginMenu("About"))
@@ -300,6 +326,23 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
                     ImGui::Text("%.3f ms/frame (%.0f FPS)",
                                 1000. / static_cast<double>(ImGui::GetIO().Framerate),
                                 static_cast<double>(ImGui::GetIO().Framerate));
+                    ImGui::TextUnformatted("|");
+                    ImGui::Text("queued tasks %zu/%zu/%zu",
+                                tp.tasks_queued(thread_pool::priority::interactive),
+                                tp.tasks_queued(thread_pool::priority::normal),
+                                tp.tasks_queued(thread_pool::priority::background));
+                    ImGui::SetItemTooltip("interactive/normal/background");
+                    ImGui::TextUnformatted("|");
+                    const font::atlas_stats font_stats = font::stats();
+                    ImGui::Text("font atlas %dx%d%s%s",
+                                font_stats.width,
+                                font_stats.height,
+                                font_stats.sdf ? " SDF" : "",
+                                font_stats.building ? " (building)" : "");
+                    ImGui::SetItemTooltip("%zu glyphs\n%zu builds, %zu restored from cache",
+                                          font_stats.glyphs,
+                                          font_stats.builds,
+                                          font_stats.cache_restores);
 
                     float right_content_size_x = 0;
                     right_content_size_x += ImGui::CalcTextSize(version_info::full_v.data()).x;
@@ -487,18 +530,23 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
 
             if(ImGui::Button(ICON_FA_WAND_MAGIC_SPARKLES " do something"))
             {
-                test_future = tp.submit(
-                  []() -> std::string
+                // replacing the handle cancels the previous job
+                test_task = tp.submit_cancellable(
+                  thread_pool::priority::interactive,
+                  [](std::stop_token stop_token) -> std::string
                   {
-                      std::this_thread::sleep_for(std::chrono::seconds(1));
+                      for(int i = 0; i < 10 && !stop_token.stop_requested(); ++i)
+                      {
+                          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                      }
                       return "test";
                   });
-            }
-            if(test_future.valid() && test_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
-            {
-                test = test_future.get();
-                test_future = {};
-                SPDLOG_LOGGER_DEBUG(logger, "test updated");
+                test_task.then_on_ui(
+                  [&test, &logger](std::string&& result)
+                  {
+                      test = std::move(result);
+                      SPDLOG_LOGGER_DEBUG(logger, "test updated");
+                  });
             }
             if(test)
             {
@@ -643,6 +691,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
         // Rendering
         ImGui::RenderNotifications();
         ImGui::Render();
+        font::prepare_render(ImGui::GetDrawData());
         int display_w, display_h;
         glfwGetFramebufferSize(main_window_handle->glf_window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
@@ -0,0 +1,325 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "binary_log.hpp"
+
+// external
+#include <fmt/compile.h>
+#include <fmt/format.h>
+#include <scope_guard.hpp>
+
+// C++ standard
+#include <charconv>
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+namespace
+{
+    // bounds checked reads over the file content, a failed read means the entry is truncated
+    class reader
+    {
+    public:
+        explicit reader(std::string_view data) noexcept : _data(data)
+        {
+        }
+
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _position == _data.size();
+        }
+
+        [[nodiscard]] std::optional<uint8_t> byte() noexcept
+        {
+            if(empty())
+            {
+                return std::nullopt;
+            }
+            return static_cast<uint8_t>(_data[_position++]);
+        }
+
+        [[nodiscard]] std::optional<uint64_t> varint() noexcept
+        {
+            uint64_t value = 0;
+            for(unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                const std::optional<uint8_t> b = byte();
+                if(!b)
+                {
+                    return std::nullopt;
+                }
+                value |= static_cast<uint64_t>(*b & 0x7F) << shift;
+                if((*b & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+            return std::nullopt;
+        }
+
+        [[nodiscard]] std::optional<std::string_view> bytes(uint64_t size) noexcept
+        {
+            if(size > _data.size() - _position)
+            {
+                return std::nullopt;
+            }
+            const std::string_view result = _data.substr(_position, static_cast<size_t>(size));
+            _position += static_cast<size_t>(size);
+            return result;
+        }
+
+    private:
+        std::string_view _data;
+        size_t _position = 0;
+    };
+
+    constexpr size_t MAX_ARGUMENT_DIGITS = 19;
+
+    [[nodiscard]] constexpr bool is_digit(char c) noexcept
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    struct argument_range
+    {
+        size_t position;
+        size_t size;
+    };
+
+    // first decimal number argument of text from position, empty if none
+    [[nodiscard]] argument_range next_argument(std::string_view text, size_t position) noexcept
+    {
+        for(size_t begin = position; begin < text.size(); ++begin)
+        {
+            if(!is_digit(text[begin]))
+            {
+                continue;
+            }
+            size_t end = begin;
+            while(end < text.size() && is_digit(text[end]))
+            {
+                ++end;
+            }
+            // printed back without leading zero and parsed into an uint64_t
+            if(end - begin <= MAX_ARGUMENT_DIGITS && (end - begin == 1 || text[begin] != '0'))
+            {
+                return {begin, end - begin};
+            }
+            begin = end;
+        }
+        return {text.size(), 0};
+    }
+
+    // text between the arguments of an interned template
+    struct log_template
+    {
+        spdlog::level::level_enum level;
+        uint64_t logger_id;
+        std::vector<std::string_view> texts;
+    };
+
+    [[nodiscard]] tl::expected<std::string, std::string> read_file(const spdlog::filename_t& filename)
+    {
+        std::FILE* file = nullptr;
+        if(spdlog::details::os::fopen_s(&file, filename, SPDLOG_FILENAME_T("rb")))
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to open {}"), filename));
+        }
+        SCOPE_EXIT
+        {
+            std::fclose(file);
+        };
+
+        std::string content(spdlog::details::os::filesize(file), '\0');
+        if(std::fread(content.data(), 1, content.size(), file) != content.size())
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to read {}"), filename));
+        }
+        return content;
+    }
+} // namespace
+
+void binary_log::split_template(std::string_view payload,
+                                spdlog::level::level_enum level,
+                                uint64_t logger_id,
+                                std::string& template_entry,
+                                std::vector<uint64_t>& arguments)
+{
+    arguments.clear();
+    template_entry.clear();
+    template_entry.push_back(static_cast<char>(level));
+    write_varint(template_entry, logger_id);
+    size_t text_begin = 0;
+    for(argument_range argument = next_argument(payload, 0); argument.size != 0;
+        argument = next_argument(payload, argument.position + argument.size))
+    {
+        write_varint(template_entry, argument.position - text_begin);
+        template_entry.append(payload.substr(text_begin, argument.position - text_begin));
+        text_begin = argument.position + argument.size;
+
+        uint64_t value = 0;
+        std::from_chars(payload.data() + argument.position, payload.data() + text_begin, value);
+        arguments.push_back(value);
+    }
+    write_varint(template_entry, payload.size() - text_begin);
+    template_entry.append(payload.substr(text_begin));
+}
+
+tl::expected<size_t, std::string> binary_log::decode(const spdlog::filename_t& filename,
+                                                     spdlog::sinks::sink& sink,
+                                                     std::stop_token stop_token)
+{
+    tl::expected<std::string, std::string> content = read_file(filename);
+    if(!content)
+    {
+        return tl::make_unexpected(std::move(content.error()));
+    }
+    if(!std::string_view(*content).starts_with(MAGIC.substr(0, MAGIC.size() - 1)))
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is not a binary log file"), filename));
+    }
+    if(!std::string_view(*content).starts_with(MAGIC))
+    {
+        // the last magic byte is the format version
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is from an unsupported version"), filename));
+    }
+
+    reader in(std::string_view(*content).substr(MAGIC.size()));
+    std::vector<std::string_view> logger_names;
+    std::vector<log_template> templates;
+    std::string templated_payload;
+    std::chrono::nanoseconds time{0};
+    size_t records = 0;
+    while(!in.empty())
+    {
+        if(stop_token.stop_requested())
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("decoding of {} stopped"), filename));
+        }
+        const std::optional<uint64_t> tag = in.varint();
+        if(!tag)
+        {
+            break;
+        }
+        if(*tag == LOGGER_NAME_TAG)
+        {
+            const std::optional<uint64_t> id = in.varint();
+            const std::optional<uint64_t> size = id ? in.varint() : std::nullopt;
+            const std::optional<std::string_view> name = size ? in.bytes(*size) : std::nullopt;
+            if(!name)
+            {
+                break;
+            }
+            if(*id != logger_names.size())
+            {
+                return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is corrupted, unexpected logger id"), filename));
+            }
+            logger_names.push_back(*name);
+            continue;
+        }
+        if(*tag == TEMPLATE_TAG)
+        {
+            const std::optional<uint64_t> id = in.varint();
+            const std::optional<uint64_t> arguments_count = id ? in.varint() : std::nullopt;
+            const std::optional<uint8_t> level = arguments_count ? in.byte() : std::nullopt;
+            const std::optional<uint64_t> logger_id = level ? in.varint() : std::nullopt;
+            if(!logger_id)
+            {
+                break;
+            }
+            if(*id != templates.size() || *level >= spdlog::level::n_levels || *logger_id >= logger_names.size())
+            {
+                return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is corrupted, invalid template"), filename));
+            }
+            log_template& entry = templates.emplace_back(
+              log_template{static_cast<spdlog::level::level_enum>(*level), *logger_id, {}});
+            for(uint64_t i = 0; i <= *arguments_count; ++i)
+            {
+                const std::optional<uint64_t> size = in.varint();
+                const std::optional<std::string_view> text = size ? in.bytes(*size) : std::nullopt;
+                if(!text)
+                {
+                    break;
+                }
+                entry.texts.push_back(*text);
+            }
+            if(entry.texts.size() != *arguments_count + 1)
+            {
+                break;
+            }
+            continue;
+        }
+
+        spdlog::level::level_enum level{};
+        std::optional<uint64_t> logger_id;
+        std::optional<uint64_t> thread_id;
+        std::optional<std::string_view> payload;
+        const std::optional<uint64_t> delta = in.varint();
+        if(*tag >= FIRST_TEMPLATED_TAG)
+        {
+            if(*tag - FIRST_TEMPLATED_TAG >= templates.size())
+            {
+                return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is corrupted, unknown template id"), filename));
+            }
+            const log_template& entry = templates[*tag - FIRST_TEMPLATED_TAG];
+            level = entry.level;
+            logger_id = entry.logger_id;
+            thread_id = delta ? in.varint() : std::nullopt;
+            templated_payload.assign(entry.texts.front());
+            for(size_t i = 1; thread_id && i < entry.texts.size(); ++i)
+            {
+                const std::optional<uint64_t> argument = in.varint();
+                if(!argument)
+                {
+                    thread_id.reset();
+                    break;
+                }
+                fmt::format_to(std::back_inserter(templated_payload), FMT_COMPILE("{}"), *argument);
+                templated_payload.append(entry.texts[i]);
+            }
+            if(thread_id)
+            {
+                payload = templated_payload;
+            }
+        }
+        else if(*tag < spdlog::level::n_levels)
+        {
+            level = static_cast<spdlog::level::level_enum>(*tag);
+            logger_id = delta ? in.varint() : std::nullopt;
+            thread_id = logger_id ? in.varint() : std::nullopt;
+            const std::optional<uint64_t> size = thread_id ? in.varint() : std::nullopt;
+            payload = size ? in.bytes(*size) : std::nullopt;
+        }
+        else
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is corrupted, invalid entry {}"), filename, *tag));
+        }
+        if(!payload)
+        {
+            break;
+        }
+        if(*logger_id >= logger_names.size())
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is corrupted, unknown logger id"), filename));
+        }
+
+        time += std::chrono::nanoseconds(zigzag_decode(*delta));
+        const std::chrono::sys_time<std::chrono::nanoseconds> log_time(time);
+        spdlog::details::log_msg msg(
+          std::chrono::time_point_cast<spdlog::log_clock::duration>(log_time),
+          spdlog::source_loc{},
+          spdlog::string_view_t(logger_names[*logger_id].data(), logger_names[*logger_id].size()),
+          level,
+          spdlog::string_view_t(payload->data(), payload->size()));
+        msg.thread_id = static_cast<size_t>(*thread_id);
+        sink.log(msg);
+        ++records;
+    }
+    return records;
+}
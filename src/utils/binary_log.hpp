@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// external
+#include <spdlog/details/file_helper.h>
+#include <spdlog/details/null_mutex.h>
+#include <spdlog/details/os.h>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compact binary log file, a header followed by entries starting with a varint tag:
+//   log record:       level, zigzag varint nanoseconds since the previous record, varint logger id,
+//                     varint thread id, varint payload size, payload
+//   logger name:      LOGGER_NAME_TAG, varint id, varint size, name
+//   template:         TEMPLATE_TAG, varint id, varint arguments count, level byte, varint logger id,
+//                     then arguments count + 1 times: varint size, text
+//   templated record: FIRST_TEMPLATED_TAG + template id, zigzag varint nanoseconds since the previous record,
+//                     varint thread id, varint arguments
+// A payload is split into its template, the text around its decimal numbers, and the numbers as arguments:
+// records logged by the same call share their level, logger and template, only their arguments are written.
+// Logger names and templates are interned per file, an id is defined by its entry before its first use.
+namespace binary_log
+{
+    inline constexpr std::string_view MAGIC{"TGUIBLG\x02", 8};
+    inline constexpr uint64_t LOGGER_NAME_TAG = spdlog::level::n_levels;
+    inline constexpr uint64_t TEMPLATE_TAG = LOGGER_NAME_TAG + 1;
+    inline constexpr uint64_t FIRST_TEMPLATED_TAG = TEMPLATE_TAG + 1;
+    // per file, records not matching the interned templates are then written as is
+    inline constexpr size_t MAX_TEMPLATES = 1 << 14;
+
+    template<typename Buffer>
+    void write_varint(Buffer& buffer, uint64_t value)
+    {
+        while(value >= 0x80)
+        {
+            buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<char>(value));
+    }
+
+    [[nodiscard]] constexpr uint64_t zigzag_encode(int64_t value) noexcept
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    [[nodiscard]] constexpr int64_t zigzag_decode(uint64_t value) noexcept
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // template entry of payload, without its arguments count, and its decimal numbers arguments
+    // (digits runs without leading zero, up to 19 digits: they fit in an uint64_t and are printed back as is)
+    void split_template(std::string_view payload,
+                        spdlog::level::level_enum level,
+                        uint64_t logger_id,
+                        std::string& template_entry,
+                        std::vector<uint64_t>& arguments);
+
+    // Decode a binary log file into sink, return the number of records.
+    // A truncated last entry, from a crash while writing, is ignored.
+    // Stop is checked between records, a stopped decode returns an error.
+    [[nodiscard]] tl::expected<size_t, std::string> decode(const spdlog::filename_t& filename,
+                                                           spdlog::sinks::sink& sink,
+                                                           std::stop_token stop_token = {});
+} // namespace binary_log
+
+// Writes the raw log fields in the binary_log format, rotated by size like spdlog::sinks::rotating_file_sink:
+// file.bin -> file.1.bin -> file.2.bin ...
+template<typename Mutex>
+class binary_log_sink final : public spdlog::sinks::base_sink<Mutex>
+{
+public:
+    // the current file is rotated on open if not empty: each session starts a new file
+    binary_log_sink(spdlog::filename_t base_filename, size_t max_size, size_t max_files);
+    binary_log_sink(const binary_log_sink&) = delete;
+    binary_log_sink(binary_log_sink&&) = delete;
+    binary_log_sink& operator=(const binary_log_sink&) = delete;
+    binary_log_sink& operator=(binary_log_sink&&) = delete;
+    ~binary_log_sink() override = default;
+
+    // file.bin for index 0, file.<index>.bin otherwise
+    [[nodiscard]] spdlog::filename_t filename(size_t index) const;
+
+protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override;
+    void flush_() override;
+
+private:
+    const spdlog::filename_t _base_filename;
+    const size_t _max_size;
+    const size_t _max_files;
+    spdlog::details::file_helper _file;
+    size_t _file_size = 0;
+
+    // per file state
+    std::unordered_map<std::string, uint32_t> _logger_ids;
+    std::unordered_map<std::string, uint32_t> _template_ids;
+    std::chrono::nanoseconds _previous_time{0};
+
+    spdlog::memory_buf_t _buffer;
+    std::string _template_entry;
+    std::vector<uint64_t> _arguments;
+
+    void start_file();
+    void rotate();
+};
+
+using binary_log_sink_mt = binary_log_sink<std::mutex>;
+using binary_log_sink_st = binary_log_sink<spdlog::details::null_mutex>;
+
+template<typename Mutex>
+binary_log_sink<Mutex>::binary_log_sink(spdlog::filename_t base_filename, size_t max_size, size_t max_files)
+    : _base_filename(std::move(base_filename))
+    , _max_size(max_size)
+    , _max_files(max_files)
+{
+    _file.open(filename(0));
+    if(_file.size() > 0)
+    {
+        rotate();
+    }
+    start_file();
+}
+
+template<typename Mutex>
+spdlog::filename_t binary_log_sink<Mutex>::filename(size_t index) const
+{
+    return spdlog::sinks::rotating_file_sink<Mutex>::calc_filename(_base_filename, index);
+}
+
+template<typename Mutex>
+void binary_log_sink<Mutex>::sink_it_(const spdlog::details::log_msg& msg)
+{
+    _buffer.clear();
+
+    const std::string_view logger_name(msg.logger_name.data(), msg.logger_name.size());
+    auto [it, inserted] = _logger_ids.try_emplace(std::string(logger_name), static_cast<uint32_t>(_logger_ids.size()));
+    if(inserted)
+    {
+        binary_log::write_varint(_buffer, binary_log::LOGGER_NAME_TAG);
+        binary_log::write_varint(_buffer, it->second);
+        binary_log::write_varint(_buffer, logger_name.size());
+        _buffer.append(logger_name.data(), logger_name.data() + logger_name.size());
+    }
+
+    const std::string_view payload(msg.payload.data(), msg.payload.size());
+    binary_log::split_template(payload, msg.level, it->second, _template_entry, _arguments);
+    auto template_it = _template_ids.find(_template_entry);
+    if(template_it == _template_ids.end() && _template_ids.size() < binary_log::MAX_TEMPLATES)
+    {
+        template_it = _template_ids.emplace(_template_entry, static_cast<uint32_t>(_template_ids.size())).first;
+        binary_log::write_varint(_buffer, binary_log::TEMPLATE_TAG);
+        binary_log::write_varint(_buffer, template_it->second);
+        binary_log::write_varint(_buffer, _arguments.size());
+        _buffer.append(_template_entry.data(), _template_entry.data() + _template_entry.size());
+    }
+
+    // deltas are small and usually positive, the system clock may go back
+    const auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(msg.time.time_since_epoch());
+    const uint64_t delta = binary_log::zigzag_encode((time - _previous_time).count());
+    if(template_it != _template_ids.end())
+    {
+        binary_log::write_varint(_buffer, binary_log::FIRST_TEMPLATED_TAG + template_it->second);
+        binary_log::write_varint(_buffer, delta);
+        binary_log::write_varint(_buffer, msg.thread_id);
+        for(const uint64_t argument: _arguments)
+        {
+            binary_log::write_varint(_buffer, argument);
+        }
+    }
+    else
+    {
+        binary_log::write_varint(_buffer, static_cast<uint64_t>(msg.level));
+        binary_log::write_varint(_buffer, delta);
+        binary_log::write_varint(_buffer, it->second);
+        binary_log::write_varint(_buffer, msg.thread_id);
+        binary_log::write_varint(_buffer, payload.size());
+        _buffer.append(payload.data(), payload.data() + payload.size());
+    }
+    _previous_time = time;
+
+    if(_file_size > binary_log::MAGIC.size() && _file_size + _buffer.size() > _max_size)
+    {
+        // the new file needs its own logger names, templates and time base
+        rotate();
+        start_file();
+        sink_it_(msg);
+        return;
+    }
+    _file.write(_buffer);
+    _file_size += _buffer.size();
+}
+
+template<typename Mutex>
+void binary_log_sink<Mutex>::flush_()
+{
+    _file.flush();
+}
+
+template<typename Mutex>
+void binary_log_sink<Mutex>::start_file()
+{
+    _logger_ids.clear();
+    _template_ids.clear();
+    _previous_time = std::chrono::nanoseconds{0};
+    _buffer.clear();
+    _buffer.append(binary_log::MAGIC.data(), binary_log::MAGIC.data() + binary_log::MAGIC.size());
+    _file.write(_buffer);
+    _file_size = _buffer.size();
+}
+
+template<typename Mutex>
+void binary_log_sink<Mutex>::rotate()
+{
+    _file.close();
+    for(size_t i = _max_files; i > 0; --i)
+    {
+        const spdlog::filename_t src = filename(i - 1);
+        if(!spdlog::details::os::path_exists(src))
+        {
+            continue;
+        }
+        const spdlog::filename_t target = filename(i);
+        spdlog::details::os::remove_if_exists(target);
+        if(spdlog::details::os::rename(src, target) != 0)
+        {
+            spdlog::throw_spdlog_ex("binary_log_sink: failed renaming " + src + " to " + target, errno);
+        }
+    }
+    _file.reopen(true);
+}
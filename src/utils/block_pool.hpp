@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// C++ standard
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace details
+{
+    // Fixed-size blocks recycled through a free list, allocated by chunks.
+    // Never released: instances live until the end of the program.
+    template<size_t Size, size_t Align>
+    class block_pool final
+    {
+    public:
+        static block_pool& instance() noexcept;
+
+        [[nodiscard]] void* acquire();
+        void release(void* free_block) noexcept;
+
+    private:
+        static constexpr size_t BLOCKS_PER_CHUNK = 64;
+
+        struct alignas(Align) block
+        {
+            std::byte data[Size];
+        };
+
+        std::mutex _mutex{};
+        std::vector<void*> _free_blocks{};
+        std::vector<std::unique_ptr<block[]>> _chunks{};
+
+        block_pool() = default;
+    };
+} // namespace details
+
+template<size_t Size, size_t Align>
+details::block_pool<Size, Align>& details::block_pool<Size, Align>::instance() noexcept
+{
+    // leaked on purpose: blocks may be released during static destruction
+    static block_pool* pool = new block_pool();
+    return *pool;
+}
+
+template<size_t Size, size_t Align>
+void* details::block_pool<Size, Align>::acquire()
+{
+    const std::scoped_lock lock(_mutex);
+    if(_free_blocks.empty())
+    {
+        std::unique_ptr<block[]>& chunk = _chunks.emplace_back(std::make_unique<block[]>(BLOCKS_PER_CHUNK));
+        _free_blocks.reserve(_chunks.size() * BLOCKS_PER_CHUNK);
+        for(size_t i = 0; i < BLOCKS_PER_CHUNK; ++i)
+        {
+            _free_blocks.push_back(&chunk[i]);
+        }
+    }
+    void* free_block = _free_blocks.back();
+    _free_blocks.pop_back();
+    return free_block;
+}
+
+template<size_t Size, size_t Align>
+void details::block_pool<Size, Align>::release(void* free_block) noexcept
+{
+    const std::scoped_lock lock(_mutex);
+    // capacity reserved on acquire, never reallocates
+    _free_blocks.push_back(free_block);
+}
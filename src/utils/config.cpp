@@ -23,6 +23,7 @@ namespace
 {
     constexpr std::string_view settings_filename = "settings.toml";
     constexpr std::string_view imgui_ini_settings_filename = "imgui.ini";
+    constexpr std::string_view fonts_atlas_cache_folder = "font_cache";
 
     std::filesystem::path get_config_folder_path() noexcept
     {
@@ -121,3 +122,14 @@ std::string config::imgui::get_ini_settings_path() noexcept
 
     return path.generic_string();
 }
+
+std::string config::fonts::get_atlas_cache_folder_path() noexcept
+{
+    std::filesystem::path path = get_config_folder_path();
+    path.append(fonts_atlas_cache_folder);
+
+    std::error_code ignored;
+    std::filesystem::create_directories(path, ignored);
+
+    return path.generic_string();
+}
@@ -42,4 +42,10 @@ namespace config
     {
         [[nodiscard]] std::string get_ini_settings_path() noexcept;
     } // namespace imgui
+
+    namespace fonts
+    {
+        // folder of the font atlas cache files, created if missing
+        [[nodiscard]] std::string get_atlas_cache_folder_path() noexcept;
+    } // namespace fonts
 } // namespace config
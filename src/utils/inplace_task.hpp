@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// C++ standard
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only void() callable with small buffer storage.
+// Callables up to inline_size bytes with a noexcept move constructor never touch the allocator.
+class inplace_task final
+{
+public:
+    static constexpr size_t inline_size = 6 * sizeof(void*);
+
+    inplace_task() noexcept = default;
+
+    template<typename Func>
+        requires(!std::same_as<std::remove_cvref_t<Func>, inplace_task> && std::invocable<std::decay_t<Func>&>)
+    inplace_task(Func&& func);
+
+    inplace_task(const inplace_task&) = delete;
+    inplace_task(inplace_task&& other) noexcept;
+    inplace_task& operator=(const inplace_task&) = delete;
+    inplace_task& operator=(inplace_task&& other) noexcept;
+    inplace_task& operator=(std::nullptr_t) noexcept;
+
+    ~inplace_task() noexcept;
+
+    explicit operator bool() const noexcept;
+
+    void operator()();
+
+private:
+    struct operations
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Func>
+    static constexpr bool stored_inline = sizeof(Func) <= inline_size && alignof(Func) <= alignof(std::max_align_t)
+                                          && std::is_nothrow_move_constructible_v<Func>;
+
+    template<typename Func>
+    static const operations inline_operations;
+
+    template<typename Func>
+    static const operations heap_operations;
+
+    alignas(std::max_align_t) std::byte _storage[inline_size];
+    const operations* _operations = nullptr;
+
+    void reset() noexcept;
+};
+
+template<typename Func>
+const inplace_task::operations inplace_task::inline_operations{
+  [](void* storage) { std::invoke(*std::launder(static_cast<Func*>(storage))); },
+  [](void* dst, void* src) noexcept
+  {
+      Func* src_func = std::launder(static_cast<Func*>(src));
+      ::new(dst) Func(std::move(*src_func));
+      src_func->~Func();
+  },
+  [](void* storage) noexcept { std::launder(static_cast<Func*>(storage))->~Func(); },
+};
+
+template<typename Func>
+const inplace_task::operations inplace_task::heap_operations{
+  [](void* storage) { std::invoke(**static_cast<Func**>(storage)); },
+  [](void* dst, void* src) noexcept { ::new(dst) Func*(*static_cast<Func**>(src)); },
+  [](void* storage) noexcept { delete *static_cast<Func**>(storage); },
+};
+
+template<typename Func>
+    requires(!std::same_as<std::remove_cvref_t<Func>, inplace_task> && std::invocable<std::decay_t<Func>&>)
+inplace_task::inplace_task(Func&& func)
+{
+    using stored_t = std::decay_t<Func>;
+    if constexpr(stored_inline<stored_t>)
+    {
+        ::new(static_cast<void*>(_storage)) stored_t(std::forward<Func>(func));
+        _operations = &inline_operations<stored_t>;
+    }
+    else
+    {
+        ::new(static_cast<void*>(_storage)) stored_t*(new stored_t(std::forward<Func>(func)));
+        _operations = &heap_operations<stored_t>;
+    }
+}
+
+inline inplace_task::inplace_task(inplace_task&& other) noexcept : _operations(other._operations)
+{
+    if(_operations != nullptr)
+    {
+        _operations->move(_storage, other._storage);
+        other._operations = nullptr;
+    }
+}
+
+inline inplace_task& inplace_task::operator=(inplace_task&& other) noexcept
+{
+    if(this != &other)
+    {
+        reset();
+        if(other._operations != nullptr)
+        {
+            other._operations->move(_storage, other._storage);
+            _operations = other._operations;
+            other._operations = nullptr;
+        }
+    }
+    return *this;
+}
+
+inline inplace_task& inplace_task::operator=(std::nullptr_t) noexcept
+{
+    reset();
+    return *this;
+}
+
+inline inplace_task::~inplace_task() noexcept
+{
+    reset();
+}
+
+inline inplace_task::operator bool() const noexcept
+{
+    return _operations != nullptr;
+}
+
+inline void inplace_task::operator()()
+{
+    _operations->invoke(_storage);
+}
+
+inline void inplace_task::reset() noexcept
+{
+    if(_operations != nullptr)
+    {
+        _operations->destroy(_storage);
+        _operations = nullptr;
+    }
+}
@@ -10,9 +10,11 @@
 #include "log.hpp"
 
 // project
+#include <utils/binary_log.hpp>
 #include <utils/store_sink.hpp>
 
 // external
+#include <spdlog/async.h>
 #include <spdlog/sinks/null_sink.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -25,12 +27,15 @@
 namespace
 {
     constexpr bool enable_console_log = true;
+    constexpr bool enable_binary_log = true;
+    constexpr bool enable_store_file = true;
+    constexpr std::size_t STORED_LOGS_CAPACITY_MB = 64;
 } // namespace
 
 const std::shared_ptr<spdlog::logger> NULL_LOGGER =
   std::make_shared<spdlog::logger>("null", std::make_shared<spdlog::sinks::null_sink_mt>());
 
-const std::shared_ptr<store_sink_mt> STORED_LOGS = std::make_shared<store_sink_mt>();
+const std::shared_ptr<store_sink_mt> STORED_LOGS = std::make_shared<store_sink_mt>(STORED_LOGS_CAPACITY_MB);
 
 namespace
 {
@@ -38,18 +43,53 @@ namespace
     constexpr std::size_t LOG_MAX_SIZE = 1024 * 1024 * 5;
     constexpr std::size_t LOG_MAX_FILES = 3;
 
+    constexpr const char* STORE_FILENAME = "log.store";
+
+    constexpr const char* BINARY_LOG_FILENAME = "log.bin";
+    constexpr std::size_t BINARY_LOG_MAX_SIZE = 1024 * 1024 * 5;
+    constexpr std::size_t BINARY_LOG_MAX_FILES = 3;
+
     std::vector<spdlog::sink_ptr> sinks;
+    std::shared_ptr<binary_log_sink_mt> binary_sink;
+    logging::options current_options;
+
+    constexpr spdlog::async_overflow_policy to_spdlog_policy(logging::overflow_policy policy) noexcept
+    {
+        switch(policy)
+        {
+            case logging::overflow_policy::block:
+                return spdlog::async_overflow_policy::block;
+            case logging::overflow_policy::drop_oldest:
+                return spdlog::async_overflow_policy::overrun_oldest;
+            case logging::overflow_policy::drop_new:
+                return spdlog::async_overflow_policy::discard_new;
+        }
+        return spdlog::async_overflow_policy::block;
+    }
 } // namespace
 
-bool logging::init_logger() noexcept
+bool logging::init_logger(const options& init_options) noexcept
 {
     assert(NULL_LOGGER != nullptr);
     try
     {
+        // single I/O thread: the sinks are not written concurrently and the messages stay in order
+        current_options = init_options;
+        if(current_options.async)
+        {
+            spdlog::init_thread_pool(current_options.queue_size, 1);
+        }
+
         // Store sink
         assert(STORED_LOGS != nullptr);
         STORED_LOGS->set_level(spdlog::level::trace);
         sinks.push_back(STORED_LOGS);
+        tl::expected<std::size_t, std::string> restored_logs = 0;
+        if constexpr(enable_store_file)
+        {
+            // before any log: the logs of the previous run are browsable right away
+            restored_logs = STORED_LOGS->open_file(STORE_FILENAME);
+        }
 
         // File sink
         std::shared_ptr<spdlog::sinks::sink> file_sink =
@@ -58,6 +98,16 @@ bool logging::init_logger() noexcept
         file_sink->set_level(spdlog::level::trace);
         sinks.push_back(file_sink);
 
+        // Binary file sink
+        if constexpr(enable_binary_log)
+        {
+            binary_sink =
+              std::make_shared<binary_log_sink_mt>(BINARY_LOG_FILENAME, BINARY_LOG_MAX_SIZE, BINARY_LOG_MAX_FILES);
+            assert(binary_sink != nullptr);
+            binary_sink->set_level(spdlog::level::trace);
+            sinks.push_back(binary_sink);
+        }
+
         // Console sink
         if constexpr(enable_console_log)
         {
@@ -68,6 +118,14 @@ bool logging::init_logger() noexcept
         }
 
         get_logger()->info("Loggers initialised");
+        if(!restored_logs)
+        {
+            get_logger()->warn("Failed to open the log store file: {}", restored_logs.error());
+        }
+        else if(*restored_logs > 0)
+        {
+            get_logger()->info("Restored {} logs from the log store file", *restored_logs);
+        }
     }
     catch(const spdlog::spdlog_ex& ex)
     {
@@ -86,7 +144,18 @@ std::shared_ptr<spdlog::logger> logging::get_logger(const std::string& name) noe
         return logger;
     }
 
-    logger = std::make_shared<spdlog::logger>(name, sinks.cbegin(), sinks.cend());
+    if(current_options.async)
+    {
+        logger = std::make_shared<spdlog::async_logger>(name,
+                                                        sinks.cbegin(),
+                                                        sinks.cend(),
+                                                        spdlog::thread_pool(),
+                                                        to_spdlog_policy(current_options.overflow));
+    }
+    else
+    {
+        logger = std::make_shared<spdlog::logger>(name, sinks.cbegin(), sinks.cend());
+    }
     assert(logger != nullptr);
     logger->set_level(spdlog::level::trace);
     logger->flush_on(spdlog::level::err);
@@ -94,3 +163,41 @@ std::shared_ptr<spdlog::logger> logging::get_logger(const std::string& name) noe
 
     return logger;
 }
+
+std::optional<logging::async_metrics> logging::get_async_metrics() noexcept
+{
+    const std::shared_ptr<spdlog::details::thread_pool> pool = spdlog::thread_pool();
+    if(!current_options.async || pool == nullptr)
+    {
+        return std::nullopt;
+    }
+    return async_metrics{
+      pool->queue_size(),
+      current_options.queue_size,
+      pool->overrun_counter(),
+      pool->discard_counter(),
+    };
+}
+
+std::vector<spdlog::filename_t> logging::previous_binary_logs() noexcept
+{
+    std::vector<spdlog::filename_t> files;
+    if(binary_sink)
+    {
+        for(size_t i = 1; i <= BINARY_LOG_MAX_FILES; ++i)
+        {
+            spdlog::filename_t filename = binary_sink->filename(i);
+            if(spdlog::details::os::path_exists(filename))
+            {
+                files.push_back(std::move(filename));
+            }
+        }
+    }
+    return files;
+}
+
+void logging::shutdown() noexcept
+{
+    // the queued messages are written before the I/O thread is joined
+    spdlog::shutdown();
+}
@@ -16,6 +16,15 @@
 #include <spdlog/sinks/null_sink.h>
 #include <spdlog/spdlog.h>
 
+// C++ standard
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
 extern const std::shared_ptr<spdlog::logger> NULL_LOGGER;
 extern const std::shared_ptr<store_sink_mt> STORED_LOGS;
 
@@ -26,6 +35,66 @@ inline std::ostream& operator<<(std::ostream& os, const std::filesystem::path& p
 
 namespace logging
 {
-    [[nodiscard]] bool init_logger() noexcept;
+    // what an async logger does when its queue is full
+    enum class overflow_policy
+    {
+        block,       // wait for the I/O thread to make room
+        drop_oldest, // replace the oldest queued message
+        drop_new,    // discard the new message
+    };
+
+    struct options
+    {
+        // sinks run on a dedicated I/O thread, loggers only enqueue messages
+        bool async = true;
+        size_t queue_size = 8192;
+        overflow_policy overflow = overflow_policy::drop_oldest;
+    };
+
+    struct async_metrics
+    {
+        size_t queue_depth = 0;
+        size_t queue_capacity = 0;
+        size_t dropped_oldest = 0;
+        size_t dropped_new = 0;
+    };
+
+    [[nodiscard]] bool init_logger(const options& init_options = {}) noexcept;
     [[nodiscard]] std::shared_ptr<spdlog::logger> get_logger(const std::string& name = "general") noexcept;
+
+    // nullopt when logging synchronously
+    [[nodiscard]] std::optional<async_metrics> get_async_metrics() noexcept;
+
+    // binary log files written before the current one, most recent first, see binary_log::decode
+    [[nodiscard]] std::vector<spdlog::filename_t> previous_binary_logs() noexcept;
+
+    // flush the queued messages and stop the I/O thread, loggers must not be used afterwards
+    void shutdown() noexcept;
+
+    // string literal usable as a template argument
+    template<size_t N>
+    struct fixed_string
+    {
+        char value[N];
+
+        constexpr fixed_string(const char (&str)[N]) noexcept
+        {
+            std::copy_n(str, N, value);
+        }
+
+        [[nodiscard]] constexpr std::string_view view() const noexcept
+        {
+            return {value, N - 1};
+        }
+    };
+
+    // Logger resolved by name on first use only, then a plain load without the registry lock and lookup:
+    //   SPDLOG_LOGGER_DEBUG(logging::static_logger<"font">(), "...");
+    // Must not be used before init_logger.
+    template<fixed_string Name>
+    [[nodiscard]] const std::shared_ptr<spdlog::logger>& static_logger() noexcept
+    {
+        static const std::shared_ptr<spdlog::logger> logger = get_logger(std::string(Name.view()));
+        return logger;
+    }
 } // namespace logging
@@ -0,0 +1,476 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "log_query.hpp"
+
+// project
+#include <utils/parallel.hpp>
+
+// external
+#include <fmt/compile.h>
+#include <fmt/format.h>
+#include <tao/pegtl.hpp>
+
+// C++ standard
+#include <algorithm>
+#include <charconv>
+
+namespace
+{
+    namespace pegtl = tao::pegtl;
+
+    // terms collected by the parser actions
+    struct query_terms
+    {
+        std::chrono::system_clock::time_point now;
+
+        spdlog::level::level_enum min_level = spdlog::level::trace;
+        spdlog::level::level_enum max_level = spdlog::level::off;
+        std::chrono::system_clock::time_point since = std::chrono::system_clock::time_point::min();
+        std::chrono::system_clock::time_point until = std::chrono::system_clock::time_point::max();
+        std::vector<log_matcher> loggers;
+        std::vector<log_matcher> texts;
+        std::vector<std::regex> regexes;
+
+        // last parsed values
+        std::string value;
+        std::string level_operator;
+        int64_t duration_count = 0;
+        std::chrono::system_clock::duration duration{};
+
+        // first semantic error
+        std::string error;
+    };
+
+    namespace grammar
+    {
+        struct separator : pegtl::plus<pegtl::space>
+        {
+        };
+
+        struct quoted_char : pegtl::sor<pegtl::seq<pegtl::one<'\\'>, pegtl::any>, pegtl::not_one<'"'>>
+        {
+        };
+        struct quoted : pegtl::seq<pegtl::one<'"'>, pegtl::star<quoted_char>, pegtl::one<'"'>>
+        {
+        };
+        struct bare : pegtl::plus<pegtl::not_one<' ', '\t', '\r', '\n', '"'>>
+        {
+        };
+        struct value : pegtl::sor<quoted, bare>
+        {
+        };
+
+        struct level_operator
+            : pegtl::sor<TAO_PEGTL_STRING(">="),
+                         TAO_PEGTL_STRING("<="),
+                         TAO_PEGTL_STRING("=="),
+                         pegtl::one<'>', '<', '=', ':'>>
+        {
+        };
+        struct level_name : pegtl::plus<pegtl::alpha>
+        {
+        };
+        struct level_term : pegtl::seq<TAO_PEGTL_ISTRING("level"), level_operator, level_name>
+        {
+        };
+
+        struct logger_term : pegtl::seq<TAO_PEGTL_ISTRING("logger:"), value>
+        {
+        };
+
+        struct duration_count : pegtl::plus<pegtl::digit>
+        {
+        };
+        struct duration_unit : pegtl::sor<TAO_PEGTL_STRING("ms"), pegtl::one<'s', 'm', 'h', 'd'>>
+        {
+        };
+        struct duration : pegtl::seq<pegtl::opt<pegtl::one<'-'>>, duration_count, duration_unit>
+        {
+        };
+        struct since_term : pegtl::seq<TAO_PEGTL_ISTRING("since:"), duration>
+        {
+        };
+        struct until_term : pegtl::seq<TAO_PEGTL_ISTRING("until:"), duration>
+        {
+        };
+
+        struct regex_term : pegtl::seq<TAO_PEGTL_ISTRING("re:"), value>
+        {
+        };
+
+        struct text_term : value
+        {
+        };
+
+        struct term : pegtl::sor<level_term, logger_term, since_term, until_term, regex_term, text_term>
+        {
+        };
+
+        struct query
+            : pegtl::seq<pegtl::star<pegtl::space>,
+                         pegtl::opt<pegtl::list<term, separator>>,
+                         pegtl::star<pegtl::space>,
+                         pegtl::eof>
+        {
+        };
+    } // namespace grammar
+
+    template<typename Rule>
+    struct action : pegtl::nothing<Rule>
+    {
+    };
+
+    template<>
+    struct action<grammar::quoted>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            const std::string_view quoted = in.string_view();
+            terms.value.clear();
+            for(size_t i = 1; i + 1 < quoted.size(); ++i)
+            {
+                if(quoted[i] == '\\' && i + 2 < quoted.size())
+                {
+                    ++i;
+                }
+                terms.value.push_back(quoted[i]);
+            }
+        }
+    };
+
+    template<>
+    struct action<grammar::bare>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            terms.value = in.string();
+        }
+    };
+
+    template<>
+    struct action<grammar::level_operator>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            terms.level_operator = in.string();
+        }
+    };
+
+    template<>
+    struct action<grammar::level_name>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            terms.value = in.string();
+        }
+    };
+
+    template<>
+    struct action<grammar::level_term>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            const spdlog::level::level_enum level = spdlog::level::from_str(terms.value);
+            if(level == spdlog::level::off && terms.value != "off" && terms.error.empty())
+            {
+                terms.error = fmt::format(FMT_COMPILE("unknown level in {}"), in.string_view());
+                return;
+            }
+            const auto previous = static_cast<spdlog::level::level_enum>(std::max(0, level - 1));
+            const auto next =
+              static_cast<spdlog::level::level_enum>(std::min(level + 1, spdlog::level::n_levels - 1));
+            const std::string_view op = terms.level_operator;
+            if(op == ">=" || op == ">")
+            {
+                terms.min_level = std::max(terms.min_level, op == ">" ? next : level);
+            }
+            else if(op == "<=" || op == "<")
+            {
+                terms.max_level = std::min(terms.max_level, op == "<" ? previous : level);
+            }
+            else
+            {
+                terms.min_level = std::max(terms.min_level, level);
+                terms.max_level = std::min(terms.max_level, level);
+            }
+        }
+    };
+
+    template<>
+    struct action<grammar::logger_term>
+    {
+        template<typename ActionInput>
+        static void apply([[maybe_unused]] const ActionInput& in, query_terms& terms)
+        {
+            terms.loggers.emplace_back(terms.value);
+        }
+    };
+
+    template<>
+    struct action<grammar::duration_count>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            // keep now - duration representable
+            static constexpr int64_t MAX_DURATION_COUNT = 1'000'000;
+            const std::string_view count = in.string_view();
+            if(std::from_chars(count.data(), count.data() + count.size(), terms.duration_count).ec != std::errc{}
+               || terms.duration_count > MAX_DURATION_COUNT)
+            {
+                terms.duration_count = 0;
+                if(terms.error.empty())
+                {
+                    terms.error = fmt::format(FMT_COMPILE("invalid duration {}"), count);
+                }
+            }
+        }
+    };
+
+    template<>
+    struct action<grammar::duration_unit>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            using namespace std::chrono;
+            const std::string_view unit = in.string_view();
+            const int64_t count = terms.duration_count;
+            if(unit == "ms")
+            {
+                terms.duration = duration_cast<system_clock::duration>(milliseconds(count));
+            }
+            else if(unit == "s")
+            {
+                terms.duration = duration_cast<system_clock::duration>(seconds(count));
+            }
+            else if(unit == "m")
+            {
+                terms.duration = duration_cast<system_clock::duration>(minutes(count));
+            }
+            else if(unit == "h")
+            {
+                terms.duration = duration_cast<system_clock::duration>(hours(count));
+            }
+            else
+            {
+                terms.duration = duration_cast<system_clock::duration>(days(count));
+            }
+        }
+    };
+
+    template<>
+    struct action<grammar::since_term>
+    {
+        template<typename ActionInput>
+        static void apply([[maybe_unused]] const ActionInput& in, query_terms& terms)
+        {
+            terms.since = std::max(terms.since, terms.now - terms.duration);
+        }
+    };
+
+    template<>
+    struct action<grammar::until_term>
+    {
+        template<typename ActionInput>
+        static void apply([[maybe_unused]] const ActionInput& in, query_terms& terms)
+        {
+            terms.until = std::min(terms.until, terms.now - terms.duration);
+        }
+    };
+
+    template<>
+    struct action<grammar::regex_term>
+    {
+        template<typename ActionInput>
+        static void apply(const ActionInput& in, query_terms& terms)
+        {
+            try
+            {
+                terms.regexes.emplace_back(terms.value,
+                                           std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+            }
+            catch(const std::regex_error& e)
+            {
+                if(terms.error.empty())
+                {
+                    terms.error = fmt::format(FMT_COMPILE("invalid regex in {}: {}"), in.string_view(), e.what());
+                }
+            }
+        }
+    };
+
+    template<>
+    struct action<grammar::text_term>
+    {
+        template<typename ActionInput>
+        static void apply([[maybe_unused]] const ActionInput& in, query_terms& terms)
+        {
+            terms.texts.emplace_back(terms.value);
+        }
+    };
+} // namespace
+
+tl::expected<log_query, std::string> log_query::parse(std::string_view query,
+                                                      std::chrono::system_clock::time_point now)
+{
+    query_terms terms;
+    terms.now = now;
+    pegtl::memory_input<> input(query.data(), query.size(), "query");
+    if(!pegtl::parse<grammar::query, action>(input, terms))
+    {
+        return tl::make_unexpected(std::string(
+          R"(invalid query, expected terms like level>=warn logger:name since:-5m re:"regex" text "quoted text")"));
+    }
+    if(!terms.error.empty())
+    {
+        return tl::make_unexpected(std::move(terms.error));
+    }
+
+    log_query result;
+    result._min_level = terms.min_level;
+    result._max_level = terms.max_level;
+    result._since = terms.since;
+    result._until = terms.until;
+    result._loggers = std::move(terms.loggers);
+    result._texts = std::move(terms.texts);
+    result._regexes = std::move(terms.regexes);
+
+    // shortest texts first, most likely to be rejected early
+    std::ranges::sort(result._texts, {}, [](const log_matcher& matcher) { return matcher.pattern().size(); });
+    return result;
+}
+
+bool log_query::empty() const noexcept
+{
+    return _min_level == spdlog::level::trace && _max_level == spdlog::level::off
+           && _since == std::chrono::system_clock::time_point::min()
+           && _until == std::chrono::system_clock::time_point::max() && _loggers.empty()
+           && std::ranges::all_of(_texts, &log_matcher::empty) && _regexes.empty();
+}
+
+spdlog::level::level_enum log_query::min_level() const noexcept
+{
+    return _min_level;
+}
+
+std::string_view log_query::indexed_text() const noexcept
+{
+    return _texts.empty() ? std::string_view() : _texts.back().pattern();
+}
+
+bool log_query::matches(const store_log& log, const log_snapshot& logs) const
+{
+    if(log.level < _min_level || log.level > _max_level || log.time < _since || log.time > _until)
+    {
+        return false;
+    }
+    if(!_loggers.empty())
+    {
+        const std::string_view logger = logs.logger_name(log.logger_id);
+        if(std::ranges::none_of(_loggers, [logger](const log_matcher& matcher) { return matcher(logger); }))
+        {
+            return false;
+        }
+    }
+    return std::ranges::all_of(_texts, [&log](const log_matcher& matcher) { return matcher(log.payload); })
+           && std::ranges::all_of(_regexes,
+                                  [&log](const std::regex& regex)
+                                  { return std::regex_search(log.payload.begin(), log.payload.end(), regex); });
+}
+
+void run_log_query(thread_pool& pool,
+                   const log_snapshot& logs,
+                   const log_query& query,
+                   spdlog::level::level_enum min_level,
+                   const std::stop_token& stop_token,
+                   const std::function<void(std::vector<uint64_t>&&)>& on_batch)
+{
+    const auto segments = logs.segments();
+    const spdlog::level::level_enum level = std::max(min_level, query.min_level());
+    const std::string_view indexed_text = query.indexed_text();
+
+    auto search_segment = [&](const log_segment& segment, std::vector<uint64_t>& matches)
+    {
+        const auto [begin_index, end_index] = logs.records_range(segment);
+        std::shared_ptr<const log_segment> loaded;
+        auto check = [&](size_t index)
+        {
+            const store_log log = loaded->at(index);
+            if(log.level >= level && query.matches(log, logs))
+            {
+                matches.push_back(log.sequence);
+            }
+        };
+
+        if(logs.sealed(segment) && indexed_text.size() >= trigram_index::MIN_PATTERN_SIZE)
+        {
+            const std::vector<uint16_t> blocks = segment.search_index().candidates(indexed_text);
+            // compressed segments are only loaded if they may match
+            if(!blocks.empty())
+            {
+                loaded = segment.load();
+            }
+            for(uint16_t block: blocks)
+            {
+                const size_t block_begin = block * trigram_index::BLOCK_RECORDS;
+                const size_t block_end = std::min(block_begin + trigram_index::BLOCK_RECORDS, end_index);
+                for(size_t i = std::max(block_begin, begin_index); i < block_end; ++i)
+                {
+                    check(i);
+                }
+            }
+        }
+        else
+        {
+            loaded = segment.load();
+            for(uint16_t index: logs.level_indexes(*loaded, level))
+            {
+                check(index);
+            }
+        }
+    };
+
+    // segments are searched in parallel by groups, each group results are delivered in order
+    const size_t group_size = std::max(pool.thread_number(), static_cast<size_t>(1));
+    std::vector<std::vector<uint64_t>> groups_matches(group_size);
+    for(size_t group_begin = 0; group_begin < segments.size() && !stop_token.stop_requested();
+        group_begin += group_size)
+    {
+        const size_t group_end = std::min(group_begin + group_size, segments.size());
+        parallel_for(pool,
+                     group_begin,
+                     group_end,
+                     static_cast<size_t>(1),
+                     [&](size_t s)
+                     {
+                         if(!stop_token.stop_requested())
+                         {
+                             search_segment(*segments[s], groups_matches[s - group_begin]);
+                         }
+                     });
+
+        std::vector<uint64_t> batch;
+        for(std::vector<uint64_t>& matches: groups_matches)
+        {
+            batch.insert(batch.end(), matches.begin(), matches.end());
+            matches.clear();
+        }
+        if(!batch.empty() && !stop_token.stop_requested())
+        {
+            on_batch(std::move(batch));
+        }
+    }
+}
@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/log_snapshot.hpp>
+#include <utils/log_trigram_index.hpp>
+#include <utils/thread_pool.hpp>
+
+// external
+#include <spdlog/common.h>
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <regex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ASCII case insensitive substring matcher
+class log_matcher final
+{
+public:
+    log_matcher() = default;
+    explicit log_matcher(std::string_view pattern);
+
+    [[nodiscard]] bool empty() const noexcept;
+
+    // case folded pattern
+    [[nodiscard]] std::string_view pattern() const noexcept;
+
+    [[nodiscard]] bool operator()(std::string_view txt) const noexcept;
+
+private:
+    std::string _pattern{};
+};
+
+// Log query, space separated terms which all have to match:
+//   level>=warn level<err level=info   level range, level:info is level=info
+//   logger:glfw logger:"my logger"     logger name contains, several logger terms match any of them
+//   since:-5m until:-30s               time range relative to the parsing time, in ms, s, m, h or d
+//   re:"fail(ed|ure)"                  ECMAScript regex search, case insensitive
+//   swap "two words"                   text contains, case insensitive
+class log_query final
+{
+public:
+    log_query() = default;
+
+    [[nodiscard]] static tl::expected<log_query, std::string>
+    parse(std::string_view query, std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+    // an empty query matches every log
+    [[nodiscard]] bool empty() const noexcept;
+
+    [[nodiscard]] spdlog::level::level_enum min_level() const noexcept;
+
+    // longest text term, to look up in the trigram indexes
+    [[nodiscard]] std::string_view indexed_text() const noexcept;
+
+    // cheap filters first: level, time and logger, then texts and regexes
+    [[nodiscard]] bool matches(const store_log& log, const log_snapshot& logs) const;
+
+private:
+    spdlog::level::level_enum _min_level = spdlog::level::trace;
+    spdlog::level::level_enum _max_level = spdlog::level::off;
+    std::chrono::system_clock::time_point _since = std::chrono::system_clock::time_point::min();
+    std::chrono::system_clock::time_point _until = std::chrono::system_clock::time_point::max();
+    std::vector<log_matcher> _loggers{};
+    std::vector<log_matcher> _texts{};
+    std::vector<std::regex> _regexes{};
+};
+
+// Run query over logs on pool, with min_level as an additional level filter.
+// Matching sequences are delivered in order, by batches, to on_batch which is called from the running thread.
+// Sealed segments are looked up in their trigram index and the other ones through their level index.
+// Return early once stop is requested.
+void run_log_query(thread_pool& pool,
+                   const log_snapshot& logs,
+                   const log_query& query,
+                   spdlog::level::level_enum min_level,
+                   const std::stop_token& stop_token,
+                   const std::function<void(std::vector<uint64_t>&&)>& on_batch);
+
+inline log_matcher::log_matcher(std::string_view pattern) : _pattern(pattern)
+{
+    std::ranges::transform(_pattern, _pattern.begin(), fold_case);
+}
+
+inline bool log_matcher::empty() const noexcept
+{
+    return _pattern.empty();
+}
+
+inline std::string_view log_matcher::pattern() const noexcept
+{
+    return _pattern;
+}
+
+inline bool log_matcher::operator()(std::string_view txt) const noexcept
+{
+    return _pattern.empty() || !std::ranges::search(txt, _pattern, {}, fold_case).empty();
+}
@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "log_segment.hpp"
+
+// project
+#include <utils/lru_cache.hpp>
+
+// external
+#include <lz4.h>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    // decompressed segments are about 2 MiB each
+    constexpr size_t LOADED_SEGMENTS_CACHE_SIZE = 8;
+
+    std::mutex loaded_segments_mutex;
+    lru_cache<uint64_t, std::shared_ptr<const log_segment>> loaded_segments(LOADED_SEGMENTS_CACHE_SIZE);
+    std::atomic<uint64_t> next_compressed_id = 0;
+} // namespace
+
+std::shared_ptr<log_segment> log_segment::compress() const
+{
+    assert(!_compressed);
+    auto records = std::make_unique<compressed_records>();
+    records->id = next_compressed_id.fetch_add(1, std::memory_order_relaxed);
+    records->first_sequence = _storage->first_sequence;
+    records->size = size();
+    records->arena_used = _storage->arena_used;
+    for(size_t l = 0; l < LEVELS; ++l)
+    {
+        records->level_sizes[l] = static_cast<uint16_t>(level_count(static_cast<spdlog::level::level_enum>(l)));
+    }
+    records->records_size = records_size();
+
+    // metadata, level indexes and payloads packed in one block
+    const auto packed = std::make_unique_for_overwrite<char[]>(records->records_size);
+    char* it = packed.get();
+    it = std::copy_n(reinterpret_cast<const char*>(_storage->records.data()), records->size * sizeof(record_meta), it);
+    for(size_t l = 0; l < LEVELS; ++l)
+    {
+        const auto* indexes = reinterpret_cast<const char*>(_storage->level_indexes[l].data());
+        it = std::copy_n(indexes, records->level_sizes[l] * sizeof(uint16_t), it);
+    }
+    std::copy_n(_storage->arena.data(), records->arena_used, it);
+
+    const auto packed_size = static_cast<int>(records->records_size);
+    auto compressed = std::make_unique_for_overwrite<char[]>(static_cast<size_t>(LZ4_compressBound(packed_size)));
+    const int compressed_size =
+      LZ4_compress_default(packed.get(), compressed.get(), packed_size, LZ4_compressBound(packed_size));
+    assert(compressed_size > 0);
+    records->data_size = static_cast<size_t>(compressed_size);
+    records->data = std::make_unique_for_overwrite<char[]>(records->data_size);
+    std::memcpy(records->data.get(), compressed.get(), records->data_size);
+
+    if(!_owned_storage)
+    {
+        records->source = shared_from_this();
+    }
+
+    auto segment = std::make_shared<log_segment>(std::move(records));
+    std::lock_guard lock(_lazy_mutex);
+    segment->_search_index = _search_index;
+    return segment;
+}
+
+void log_segment::copy_to(storage& target) const
+{
+    // only the published parts, the rest of a storage is never read
+    const std::shared_ptr<const log_segment> loaded = load();
+    const storage& source = *loaded->_storage;
+    target.magic = 0;
+    target.first_sequence = source.first_sequence;
+    target.size = source.size;
+    target.arena_used = source.arena_used;
+    target.level_sizes = source.level_sizes;
+    std::memcpy(target.records.data(), source.records.data(), source.size * sizeof(record_meta));
+    for(size_t l = 0; l < LEVELS; ++l)
+    {
+        std::memcpy(
+          target.level_indexes[l].data(), source.level_indexes[l].data(), source.level_sizes[l] * sizeof(uint16_t));
+    }
+    std::memcpy(target.arena.data(), source.arena.data(), source.arena_used);
+    target.magic = storage::MAGIC;
+}
+
+std::shared_ptr<const log_segment> log_segment::load() const
+{
+    if(!_compressed)
+    {
+        return shared_from_this();
+    }
+    {
+        std::lock_guard lock(loaded_segments_mutex);
+        if(const std::shared_ptr<const log_segment>* loaded = loaded_segments.find(_compressed->id))
+        {
+            return *loaded;
+        }
+    }
+
+    std::shared_ptr<const log_segment> loaded;
+    {
+        // still alive if held by a reader after its eviction from the cache
+        std::lock_guard lock(_lazy_mutex);
+        loaded = _loaded.lock();
+        if(!loaded)
+        {
+            const auto packed = std::make_unique_for_overwrite<char[]>(_compressed->records_size);
+            [[maybe_unused]] const int packed_size = LZ4_decompress_safe(_compressed->data.get(),
+                                                                         packed.get(),
+                                                                         static_cast<int>(_compressed->data_size),
+                                                                         static_cast<int>(_compressed->records_size));
+            assert(static_cast<size_t>(packed_size) == _compressed->records_size);
+
+            auto segment = std::make_shared<log_segment>(_compressed->first_sequence);
+            storage& loaded_storage = *segment->_storage;
+            const char* it = packed.get();
+            std::memcpy(loaded_storage.records.data(), it, _compressed->size * sizeof(record_meta));
+            it += _compressed->size * sizeof(record_meta);
+            for(size_t l = 0; l < LEVELS; ++l)
+            {
+                std::memcpy(loaded_storage.level_indexes[l].data(), it, _compressed->level_sizes[l] * sizeof(uint16_t));
+                it += _compressed->level_sizes[l] * sizeof(uint16_t);
+            }
+            std::memcpy(loaded_storage.arena.data(), it, _compressed->arena_used);
+            loaded_storage.arena_used = _compressed->arena_used;
+            loaded_storage.level_sizes = _compressed->level_sizes;
+            loaded_storage.size = _compressed->size;
+            segment->_search_index = _search_index;
+            loaded = std::move(segment);
+            _loaded = loaded;
+        }
+    }
+
+    std::lock_guard lock(loaded_segments_mutex);
+    loaded_segments.insert(_compressed->id, loaded);
+    return loaded;
+}
@@ -0,0 +1,352 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/log_trigram_index.hpp>
+
+// external
+#include <spdlog/common.h>
+
+// C++ standard
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+// View on a stored log, valid while its segment is alive.
+// Only the raw message fields are stored, records are formatted when displayed.
+struct store_log final
+{
+    uint64_t sequence;
+    spdlog::level::level_enum level;
+    std::chrono::system_clock::time_point time;
+    uint32_t thread_id;
+    uint16_t logger_id;
+    std::string_view payload;
+};
+
+// Fixed capacity chunk of stored logs: payloads packed in a contiguous byte arena, metadata in a fixed array.
+// Single writer, lock-free readers: records below size() are immutable once published.
+// Records are also indexed by level: for each level L, the ordered indexes of the records at level >= L.
+// The whole state lives in a trivially copyable storage block, owned or in a mapped file (see log_store_file).
+// Sealed segments can be replaced by a compressed copy, only holding the LZ4 compressed records.
+class log_segment final : public std::enable_shared_from_this<log_segment>
+{
+public:
+    static constexpr size_t ARENA_SIZE = 1024 * 1024;
+    static constexpr size_t MAX_RECORDS = 16384;
+    static constexpr size_t LEVELS = spdlog::level::n_levels;
+
+    struct record_meta
+    {
+        std::chrono::system_clock::time_point time;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t thread_id;
+        uint16_t logger_id;
+        uint8_t level;
+    };
+
+    // published sizes are accessed through std::atomic_ref, magic is only set for initialized storages
+    struct storage
+    {
+        static constexpr uint64_t MAGIC = 0x31474553'474F4C54; // "TLOGSEG1"
+
+        uint64_t magic;
+        uint64_t first_sequence;
+        uint64_t size;
+        uint64_t arena_used;
+        std::array<uint16_t, LEVELS> level_sizes;
+        std::array<record_meta, MAX_RECORDS> records;
+        std::array<std::array<uint16_t, MAX_RECORDS>, LEVELS> level_indexes;
+        std::array<char, ARENA_SIZE> arena;
+    };
+
+    // owned storage
+    explicit log_segment(uint64_t first_sequence);
+
+    // storage kept alive by owner, adopted as is: reset() it for a new segment
+    log_segment(storage& adopted_storage, std::shared_ptr<const void> owner) noexcept;
+
+    // use compress()
+    struct compressed_records;
+    explicit log_segment(std::unique_ptr<const compressed_records> records) noexcept;
+
+    log_segment(const log_segment&) = delete;
+    log_segment(log_segment&&) = delete;
+    log_segment& operator=(const log_segment&) = delete;
+    log_segment& operator=(log_segment&&) = delete;
+    ~log_segment() noexcept = default;
+
+    // writer only, segment must not be shared anymore
+    void reset(uint64_t first_sequence) noexcept;
+
+    // compressed copy of a sealed segment, its records are read through load()
+    // a segment backed by a mapped file is kept alive by its copy: its records stay persisted
+    [[nodiscard]] std::shared_ptr<log_segment> compress() const;
+
+    [[nodiscard]] bool compressed() const noexcept;
+
+    // segment with readable records: itself, or the decompressed copy of a compressed segment
+    // the decompressed copies of the most recently loaded segments are cached
+    [[nodiscard]] std::shared_ptr<const log_segment> load() const;
+
+    // writer only or sealed segments, copy the records to target as if they were appended to it
+    void copy_to(storage& target) const;
+
+    // writer only, return false if the segment is full (payloads too large are truncated to the arena size)
+    [[nodiscard]] bool append(spdlog::level::level_enum level,
+                              std::chrono::system_clock::time_point time,
+                              uint32_t thread_id,
+                              uint16_t logger_id,
+                              std::string_view payload) noexcept;
+
+    [[nodiscard]] uint64_t first_sequence() const noexcept;
+    [[nodiscard]] uint64_t end_sequence() const noexcept;
+    [[nodiscard]] size_t size() const noexcept;
+
+    // bytes held: the whole storage, or the compressed records
+    [[nodiscard]] size_t memory_size() const noexcept;
+
+    // bytes of the published records (metadata, level indexes and payloads), before compression
+    [[nodiscard]] size_t records_size() const noexcept;
+
+    // not compressed segments only
+    [[nodiscard]] store_log at(size_t index) const noexcept;
+
+    // not compressed segments only, ordered indexes of the published records at level >= min_level
+    [[nodiscard]] std::span<const uint16_t> level_indexes(spdlog::level::level_enum min_level) const noexcept;
+
+    // number of published records at level >= min_level
+    [[nodiscard]] size_t level_count(spdlog::level::level_enum min_level) const noexcept;
+
+    // trigram index of the records, only for segments not written anymore
+    // built by the store when sealed, on first use for the restored segments and without compression pool
+    [[nodiscard]] const trigram_index& search_index() const;
+
+private:
+    std::unique_ptr<storage> _owned_storage;
+    std::shared_ptr<const void> _storage_owner;
+    storage* _storage;
+    std::unique_ptr<const compressed_records> _compressed;
+
+    // guards the lazily built members
+    mutable std::mutex _lazy_mutex;
+    mutable std::shared_ptr<const trigram_index> _search_index;
+    mutable std::weak_ptr<const log_segment> _loaded;
+
+    static_assert(MAX_RECORDS <= std::numeric_limits<uint16_t>::max());
+    static_assert(std::is_trivially_copyable_v<storage>);
+    static_assert(std::atomic_ref<uint64_t>::is_always_lock_free && std::atomic_ref<uint16_t>::is_always_lock_free);
+};
+
+struct log_segment::compressed_records
+{
+    // key of the decompressed copy in the cache
+    uint64_t id;
+    uint64_t first_sequence;
+    uint64_t size;
+    uint64_t arena_used;
+    std::array<uint16_t, LEVELS> level_sizes;
+    size_t records_size;
+    size_t data_size;
+    std::unique_ptr<char[]> data;
+    // mapped file segment, its slot must not be reused
+    std::shared_ptr<const log_segment> source;
+};
+
+inline log_segment::log_segment(uint64_t first_sequence)
+    : _owned_storage(std::make_unique_for_overwrite<storage>())
+    , _storage_owner()
+    , _storage(_owned_storage.get())
+    , _compressed()
+{
+    reset(first_sequence);
+}
+
+inline log_segment::log_segment(storage& adopted_storage, std::shared_ptr<const void> owner) noexcept
+    : _owned_storage()
+    , _storage_owner(std::move(owner))
+    , _storage(&adopted_storage)
+    , _compressed()
+{
+}
+
+inline log_segment::log_segment(std::unique_ptr<const compressed_records> records) noexcept
+    : _owned_storage()
+    , _storage_owner()
+    , _storage(nullptr)
+    , _compressed(std::move(records))
+{
+}
+
+inline void log_segment::reset(uint64_t first_sequence) noexcept
+{
+    assert(!_compressed);
+    // size first: an interrupted reset leaves an empty segment
+    std::atomic_ref(_storage->size).store(0, std::memory_order_relaxed);
+    _storage->first_sequence = first_sequence;
+    _storage->arena_used = 0;
+    _search_index.reset();
+    for(uint16_t& level_size: _storage->level_sizes)
+    {
+        std::atomic_ref(level_size).store(0, std::memory_order_relaxed);
+    }
+    _storage->magic = storage::MAGIC;
+}
+
+inline bool log_segment::append(spdlog::level::level_enum level,
+                                std::chrono::system_clock::time_point time,
+                                uint32_t thread_id,
+                                uint16_t logger_id,
+                                std::string_view payload) noexcept
+{
+    const size_t index = size();
+    if(index == MAX_RECORDS)
+    {
+        return false;
+    }
+    const size_t arena_used = _storage->arena_used;
+    if(payload.size() > ARENA_SIZE - arena_used)
+    {
+        if(index != 0)
+        {
+            return false;
+        }
+        payload = payload.substr(0, ARENA_SIZE);
+    }
+
+    std::memcpy(_storage->arena.data() + arena_used, payload.data(), payload.size());
+    record_meta& meta = _storage->records[index];
+    meta.time = time;
+    meta.offset = static_cast<uint32_t>(arena_used);
+    meta.size = static_cast<uint32_t>(payload.size());
+    meta.thread_id = thread_id;
+    meta.logger_id = logger_id;
+    meta.level = static_cast<uint8_t>(level);
+    _storage->arena_used = arena_used + payload.size();
+
+    // a level index is published before the record, readers ignore indexes not below their size
+    for(size_t l = 0; l <= static_cast<size_t>(level) && l < LEVELS; ++l)
+    {
+        std::atomic_ref level_size(_storage->level_sizes[l]);
+        const uint16_t current_size = level_size.load(std::memory_order_relaxed);
+        _storage->level_indexes[l][current_size] = static_cast<uint16_t>(index);
+        level_size.store(static_cast<uint16_t>(current_size + 1), std::memory_order_release);
+    }
+
+    // publish
+    std::atomic_ref(_storage->size).store(index + 1, std::memory_order_release);
+    return true;
+}
+
+inline bool log_segment::compressed() const noexcept
+{
+    return _compressed != nullptr;
+}
+
+inline uint64_t log_segment::first_sequence() const noexcept
+{
+    return _compressed ? _compressed->first_sequence : _storage->first_sequence;
+}
+
+inline uint64_t log_segment::end_sequence() const noexcept
+{
+    return first_sequence() + size();
+}
+
+inline size_t log_segment::size() const noexcept
+{
+    if(_compressed)
+    {
+        return static_cast<size_t>(_compressed->size);
+    }
+    return static_cast<size_t>(std::atomic_ref(_storage->size).load(std::memory_order_acquire));
+}
+
+inline size_t log_segment::memory_size() const noexcept
+{
+    return _compressed ? _compressed->data_size : sizeof(storage);
+}
+
+inline size_t log_segment::records_size() const noexcept
+{
+    if(_compressed)
+    {
+        return _compressed->records_size;
+    }
+    size_t records_size = size() * sizeof(record_meta) + _storage->arena_used;
+    for(size_t l = 0; l < LEVELS; ++l)
+    {
+        records_size += level_count(static_cast<spdlog::level::level_enum>(l)) * sizeof(uint16_t);
+    }
+    return records_size;
+}
+
+inline store_log log_segment::at(size_t index) const noexcept
+{
+    assert(!_compressed);
+    const record_meta& meta = _storage->records[index];
+    return {
+      first_sequence() + index,
+      static_cast<spdlog::level::level_enum>(meta.level),
+      meta.time,
+      meta.thread_id,
+      meta.logger_id,
+      std::string_view(_storage->arena.data() + meta.offset, meta.size),
+    };
+}
+
+inline std::span<const uint16_t> log_segment::level_indexes(spdlog::level::level_enum min_level) const noexcept
+{
+    assert(!_compressed);
+    const auto l = std::min(static_cast<size_t>(min_level), LEVELS - 1);
+    const uint16_t level_size = std::atomic_ref(_storage->level_sizes[l]).load(std::memory_order_acquire);
+    return {_storage->level_indexes[l].data(), level_size};
+}
+
+inline size_t log_segment::level_count(spdlog::level::level_enum min_level) const noexcept
+{
+    const auto l = std::min(static_cast<size_t>(min_level), LEVELS - 1);
+    if(_compressed)
+    {
+        return _compressed->level_sizes[l];
+    }
+    return std::atomic_ref(_storage->level_sizes[l]).load(std::memory_order_acquire);
+}
+
+inline const trigram_index& log_segment::search_index() const
+{
+    {
+        std::lock_guard lock(_lazy_mutex);
+        if(_search_index)
+        {
+            return *_search_index;
+        }
+    }
+    // a compressed segment is loaded once to build it, then keeps it
+    const std::shared_ptr<const log_segment> loaded = _compressed ? load() : nullptr;
+    std::lock_guard lock(_lazy_mutex);
+    if(!_search_index)
+    {
+        const log_segment& segment = loaded ? *loaded : *this;
+        _search_index =
+          std::make_shared<const trigram_index>(size(), [&segment](size_t i) { return segment.at(i).payload; });
+    }
+    return *_search_index;
+}
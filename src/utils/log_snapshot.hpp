@@ -0,0 +1,302 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/log_segment.hpp>
+#include <utils/logger_names.hpp>
+
+// C++ standard
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+using log_segment_list = std::vector<std::shared_ptr<log_segment>>;
+
+// Stable view on the stored logs in [begin_sequence(), end_sequence()).
+// Keeps its segments alive: records stay valid and unchanged for the snapshot lifetime, writers are never blocked.
+// The compressed segments read through at() are loaded once and kept by the snapshot and its copies.
+class log_snapshot final
+{
+public:
+    log_snapshot() noexcept = default;
+    log_snapshot(std::shared_ptr<const log_segment_list> segments,
+                 std::shared_ptr<const logger_names> names,
+                 uint64_t from_sequence) noexcept;
+
+    // first available sequence, greater than the requested one if older logs were evicted
+    [[nodiscard]] uint64_t begin_sequence() const noexcept;
+    [[nodiscard]] uint64_t end_sequence() const noexcept;
+    [[nodiscard]] size_t size() const noexcept;
+    [[nodiscard]] bool empty() const noexcept;
+
+    // view on the records of this snapshot from sequence onwards
+    [[nodiscard]] log_snapshot since(uint64_t sequence) const noexcept;
+
+    // name of the logger of a record of the snapshot
+    [[nodiscard]] std::string_view logger_name(uint16_t logger_id) const noexcept;
+
+    // sequence must be in [begin_sequence(), end_sequence())
+    [[nodiscard]] store_log at(uint64_t sequence) const noexcept;
+
+    // segments holding the records of the snapshot, in order
+    [[nodiscard]] std::span<const std::shared_ptr<log_segment>> segments() const noexcept;
+
+    // indexes range of the snapshot records in one of its segments
+    [[nodiscard]] std::pair<size_t, size_t> records_range(const log_segment& segment) const noexcept;
+
+    // a sealed segment is not written anymore
+    [[nodiscard]] bool sealed(const log_segment& segment) const noexcept;
+
+    // level indexes of one of its segments restricted to the records of the snapshot, not compressed (see load())
+    [[nodiscard]] std::span<const uint16_t> level_indexes(const log_segment& segment,
+                                                          spdlog::level::level_enum min_level) const noexcept;
+
+    // number of records at level >= min_level, found through the segments level indexes
+    [[nodiscard]] size_t count(spdlog::level::level_enum min_level) const noexcept;
+
+    // callable(const store_log&) returns false to stop the iteration
+    // records of compressed segments are only valid during the call, the segments are not kept loaded
+    template<typename T>
+    void iterate_on_logs(T callable) const;
+
+    // only visit the records at level >= min_level, without touching the other ones
+    template<typename T>
+    void iterate_on_logs(spdlog::level::level_enum min_level, T callable) const;
+
+private:
+    struct loaded_segments
+    {
+        std::mutex mutex;
+        std::vector<std::pair<const log_segment*, std::shared_ptr<const log_segment>>> segments;
+    };
+
+    std::shared_ptr<const log_segment_list> _segments{};
+    std::shared_ptr<loaded_segments> _loaded{};
+    std::shared_ptr<const logger_names> _names{};
+    uint64_t _begin_sequence = 0;
+    uint64_t _end_sequence = 0;
+
+    [[nodiscard]] log_segment_list::const_iterator find_segment(uint64_t sequence) const noexcept;
+
+    // segment itself if not compressed, else its loaded copy kept by the snapshot
+    [[nodiscard]] const log_segment& readable(const log_segment& segment) const;
+};
+
+inline log_snapshot::log_snapshot(std::shared_ptr<const log_segment_list> segments,
+                                  std::shared_ptr<const logger_names> names,
+                                  uint64_t from_sequence) noexcept
+    : _segments(std::move(segments))
+    , _loaded(std::make_shared<loaded_segments>())
+    , _names(std::move(names))
+{
+    if(_segments && !_segments->empty())
+    {
+        // end first: records published after it are ignored even if appended during construction
+        _end_sequence = _segments->back()->end_sequence();
+        _begin_sequence = std::min(std::max(from_sequence, _segments->front()->first_sequence()), _end_sequence);
+    }
+    else
+    {
+        _begin_sequence = _end_sequence = from_sequence;
+    }
+}
+
+inline uint64_t log_snapshot::begin_sequence() const noexcept
+{
+    return _begin_sequence;
+}
+
+inline uint64_t log_snapshot::end_sequence() const noexcept
+{
+    return _end_sequence;
+}
+
+inline size_t log_snapshot::size() const noexcept
+{
+    return static_cast<size_t>(_end_sequence - _begin_sequence);
+}
+
+inline bool log_snapshot::empty() const noexcept
+{
+    return _begin_sequence == _end_sequence;
+}
+
+inline log_snapshot log_snapshot::since(uint64_t sequence) const noexcept
+{
+    log_snapshot view = *this;
+    view._begin_sequence = std::clamp(sequence, _begin_sequence, _end_sequence);
+    return view;
+}
+
+inline std::string_view log_snapshot::logger_name(uint16_t logger_id) const noexcept
+{
+    assert(_names);
+    return _names->name(logger_id);
+}
+
+inline store_log log_snapshot::at(uint64_t sequence) const noexcept
+{
+    assert(sequence >= _begin_sequence && sequence < _end_sequence);
+    const log_segment& segment = readable(**find_segment(sequence));
+    return segment.at(static_cast<size_t>(sequence - segment.first_sequence()));
+}
+
+template<typename T>
+void log_snapshot::iterate_on_logs(T callable) const
+{
+    if(empty())
+    {
+        return;
+    }
+    uint64_t sequence = _begin_sequence;
+    for(auto it = find_segment(sequence); it != _segments->end() && sequence < _end_sequence; ++it)
+    {
+        const std::shared_ptr<const log_segment> loaded = (*it)->load();
+        const log_segment& segment = *loaded;
+        const uint64_t segment_end = std::min(segment.first_sequence() + segment.size(), _end_sequence);
+        for(; sequence < segment_end; ++sequence)
+        {
+            if(!callable(segment.at(static_cast<size_t>(sequence - segment.first_sequence()))))
+            {
+                return;
+            }
+        }
+    }
+}
+
+inline std::span<const std::shared_ptr<log_segment>> log_snapshot::segments() const noexcept
+{
+    if(empty())
+    {
+        return {};
+    }
+    const auto first = find_segment(_begin_sequence);
+    const auto last = std::next(find_segment(_end_sequence - 1));
+    return {first, last};
+}
+
+inline std::pair<size_t, size_t> log_snapshot::records_range(const log_segment& segment) const noexcept
+{
+    const uint64_t first = segment.first_sequence();
+    return {
+      static_cast<size_t>(std::clamp(_begin_sequence, first, first + segment.size()) - first),
+      static_cast<size_t>(std::clamp(_end_sequence, first, first + segment.size()) - first),
+    };
+}
+
+inline bool log_snapshot::sealed(const log_segment& segment) const noexcept
+{
+    return _segments && !_segments->empty() && &segment != _segments->back().get();
+}
+
+inline size_t log_snapshot::count(spdlog::level::level_enum min_level) const noexcept
+{
+    if(min_level <= spdlog::level::trace)
+    {
+        return size();
+    }
+    size_t count = 0;
+    if(!empty())
+    {
+        for(auto it = find_segment(_begin_sequence); it != _segments->end(); ++it)
+        {
+            if((*it)->first_sequence() >= _end_sequence)
+            {
+                break;
+            }
+            const log_segment& segment = **it;
+            if(segment.compressed() && segment.first_sequence() >= _begin_sequence
+               && segment.end_sequence() <= _end_sequence)
+            {
+                count += segment.level_count(min_level);
+            }
+            else
+            {
+                count += level_indexes(*segment.load(), min_level).size();
+            }
+        }
+    }
+    return count;
+}
+
+template<typename T>
+void log_snapshot::iterate_on_logs(spdlog::level::level_enum min_level, T callable) const
+{
+    if(min_level <= spdlog::level::trace)
+    {
+        iterate_on_logs(std::move(callable));
+        return;
+    }
+    if(empty())
+    {
+        return;
+    }
+    for(auto it = find_segment(_begin_sequence); it != _segments->end(); ++it)
+    {
+        if((*it)->first_sequence() >= _end_sequence)
+        {
+            return;
+        }
+        const std::shared_ptr<const log_segment> loaded = (*it)->load();
+        const log_segment& segment = *loaded;
+        for(uint16_t index: level_indexes(segment, min_level))
+        {
+            if(!callable(segment.at(index)))
+            {
+                return;
+            }
+        }
+    }
+}
+
+inline log_segment_list::const_iterator log_snapshot::find_segment(uint64_t sequence) const noexcept
+{
+    // segments are ordered by sequence, find the last one starting at or before sequence
+    auto it = std::upper_bound(_segments->begin(),
+                               _segments->end(),
+                               sequence,
+                               [](uint64_t value, const std::shared_ptr<log_segment>& segment)
+                               { return value < segment->first_sequence(); });
+    assert(it != _segments->begin());
+    return std::prev(it);
+}
+
+inline std::span<const uint16_t> log_snapshot::level_indexes(const log_segment& segment,
+                                                             spdlog::level::level_enum min_level) const noexcept
+{
+    const uint64_t first = segment.first_sequence();
+    const auto begin_index = static_cast<size_t>(std::max(_begin_sequence, first) - first);
+    const auto end_index = static_cast<size_t>(std::min(_end_sequence, segment.end_sequence()) - first);
+    const std::span<const uint16_t> indexes = segment.level_indexes(min_level);
+    const auto begin = std::lower_bound(indexes.begin(), indexes.end(), begin_index);
+    const auto end = std::lower_bound(begin, indexes.end(), end_index);
+    return {begin, end};
+}
+
+inline const log_segment& log_snapshot::readable(const log_segment& segment) const
+{
+    if(!segment.compressed())
+    {
+        return segment;
+    }
+    std::lock_guard lock(_loaded->mutex);
+    for(const auto& [compressed, loaded]: _loaded->segments)
+    {
+        if(compressed == &segment)
+        {
+            return *loaded;
+        }
+    }
+    return *_loaded->segments.emplace_back(&segment, segment.load()).second;
+}
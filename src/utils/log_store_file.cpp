@@ -0,0 +1,283 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "log_store_file.hpp"
+
+// project
+#include <utils/logger_names.hpp>
+
+// C++ standard
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <utility>
+
+tl::expected<std::shared_ptr<log_store_file>, std::string> log_store_file::open(const std::filesystem::path& path,
+                                                                                size_t slots)
+{
+    tl::expected<mapped_file, std::string> file = mapped_file::open(path, SLOTS_OFFSET + slots * SLOT_SIZE);
+    if(!file)
+    {
+        return tl::make_unexpected(std::move(file.error()));
+    }
+    auto store_file = std::make_shared<log_store_file>(std::move(*file), slots);
+
+    header& file_header = store_file->file_header();
+    if(file_header.magic != header::MAGIC || file_header.storage_size != sizeof(log_segment::storage)
+       || file_header.slots != slots)
+    {
+        // new file or other layout: only the headers have to be cleared, slots without magic are unused
+        file_header = {header::MAGIC, sizeof(log_segment::storage), slots, 0, 0};
+        for(size_t i = 0; i < slots; ++i)
+        {
+            store_file->slot(i).magic = 0;
+        }
+    }
+    return store_file;
+}
+
+log_store_file::log_store_file(mapped_file&& file, size_t slots) noexcept
+    : _file(std::move(file))
+    , _slots(slots)
+    , _slot_segments(slots)
+    , _slot_copies(slots, false)
+{
+}
+
+std::vector<std::string_view> log_store_file::restore_names() const
+{
+    const header& file_header = this->file_header();
+    const auto* names = reinterpret_cast<const char*>(_file.data() + NAMES_OFFSET);
+    std::vector<std::string_view> result;
+    result.reserve(file_header.names_count);
+    // read from the file: a corrupted header must not move the names out of their region
+    const size_t names_used = std::min<size_t>(file_header.names_used, NAMES_SIZE);
+    size_t offset = 0;
+    for(uint32_t i = 0; i < file_header.names_count && offset + sizeof(uint16_t) <= names_used; ++i)
+    {
+        uint16_t size;
+        std::memcpy(&size, names + offset, sizeof(size));
+        offset += sizeof(size);
+        if(size > names_used - offset)
+        {
+            break;
+        }
+        result.emplace_back(names + offset, size);
+        offset += size;
+    }
+    return result;
+}
+
+std::vector<std::shared_ptr<log_segment>> log_store_file::restore_segments(size_t max_segments,
+                                                                            size_t names_count)
+{
+    std::vector<size_t> valid_slots;
+    for(size_t i = 0; i < _slots; ++i)
+    {
+        if(!slot_valid(i))
+        {
+            continue;
+        }
+        if(!slot_consistent(i, names_count))
+        {
+            // truncated or corrupted, readers would index out of the storage
+            slot(i).magic = 0;
+            continue;
+        }
+        valid_slots.push_back(i);
+    }
+    std::ranges::sort(valid_slots, {}, [this](size_t i) noexcept { return slot(i).first_sequence; });
+
+    // snapshots expect consecutive sequences, keep the most recent run of them
+    auto first = valid_slots.end();
+    while(first != valid_slots.begin() && static_cast<size_t>(valid_slots.end() - first) < max_segments)
+    {
+        const auto previous = std::prev(first);
+        if(first != valid_slots.end())
+        {
+            const log_segment::storage& storage = slot(*previous);
+            if(storage.first_sequence + storage.size != slot(*first).first_sequence)
+            {
+                break;
+            }
+        }
+        first = previous;
+    }
+
+    std::vector<std::shared_ptr<log_segment>> segments;
+    segments.reserve(static_cast<size_t>(valid_slots.end() - first));
+    for(auto it = first; it != valid_slots.end(); ++it)
+    {
+        segments.push_back(make_segment(*it));
+    }
+    return segments;
+}
+
+std::shared_ptr<log_segment> log_store_file::new_segment(uint64_t first_sequence)
+{
+    const size_t index = unused_slot();
+    if(index == _slots)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<log_segment> segment = make_segment(index);
+    segment->reset(first_sequence);
+    return segment;
+}
+
+bool log_store_file::persist(const std::shared_ptr<const log_segment>& segment)
+{
+    size_t index = 0;
+    while(index < _slots && _slot_segments[index].lock() != segment)
+    {
+        ++index;
+    }
+    if(index == _slots)
+    {
+        index = unused_slot();
+        if(index == _slots)
+        {
+            return false;
+        }
+        _slot_segments[index] = segment;
+        _slot_copies[index] = true;
+    }
+    else if(!_slot_copies[index])
+    {
+        // backed by the file
+        return true;
+    }
+
+    // records are only appended: a copy with as many records is up to date
+    log_segment::storage& storage = slot(index);
+    if(storage.magic != log_segment::storage::MAGIC || storage.first_sequence != segment->first_sequence()
+       || storage.size != segment->size())
+    {
+        segment->copy_to(storage);
+    }
+    return true;
+}
+
+bool log_store_file::persist_name(uint16_t id, std::string_view name)
+{
+    header& file_header = this->file_header();
+    const size_t size = std::min<size_t>(name.size(), std::numeric_limits<uint16_t>::max());
+    if(id != file_header.names_count || file_header.names_used + sizeof(uint16_t) + size > NAMES_SIZE)
+    {
+        return false;
+    }
+    auto* names = reinterpret_cast<char*>(_file.data() + NAMES_OFFSET);
+    const auto name_size = static_cast<uint16_t>(size);
+    std::memcpy(names + file_header.names_used, &name_size, sizeof(name_size));
+    std::memcpy(names + file_header.names_used + sizeof(name_size), name.data(), size);
+    file_header.names_used += static_cast<uint32_t>(sizeof(name_size) + size);
+    ++file_header.names_count;
+    return true;
+}
+
+void log_store_file::release(const log_segment& segment,
+                             const std::shared_ptr<const log_segment>& replacement) noexcept
+{
+    for(size_t i = 0; i < _slots; ++i)
+    {
+        if(_slot_segments[i].lock().get() == &segment)
+        {
+            _file.discard(SLOTS_OFFSET + i * SLOT_SIZE, SLOT_SIZE);
+            _slot_segments[i] = replacement;
+            return;
+        }
+    }
+}
+
+void log_store_file::flush() noexcept
+{
+    _file.flush();
+}
+
+log_store_file::header& log_store_file::file_header() const noexcept
+{
+    return *reinterpret_cast<header*>(_file.data());
+}
+
+log_segment::storage& log_store_file::slot(size_t index) const noexcept
+{
+    return *reinterpret_cast<log_segment::storage*>(_file.data() + SLOTS_OFFSET + index * SLOT_SIZE);
+}
+
+bool log_store_file::slot_valid(size_t index) const noexcept
+{
+    const log_segment::storage& storage = slot(index);
+    return storage.magic == log_segment::storage::MAGIC && storage.size > 0 && storage.size <= log_segment::MAX_RECORDS;
+}
+
+bool log_store_file::slot_consistent(size_t index, size_t names_count) const noexcept
+{
+    const log_segment::storage& storage = slot(index);
+    const size_t size = static_cast<size_t>(storage.size);
+    if(storage.arena_used > log_segment::ARENA_SIZE)
+    {
+        return false;
+    }
+    for(size_t i = 0; i < size; ++i)
+    {
+        const log_segment::record_meta& meta = storage.records[i];
+        if(meta.level >= log_segment::LEVELS || meta.offset > storage.arena_used
+           || meta.size > storage.arena_used - meta.offset
+           || (meta.logger_id >= names_count && meta.logger_id != logger_names::OVERFLOW_ID))
+        {
+            return false;
+        }
+    }
+    // level index L holds the records at level >= L: each one is included in the previous
+    for(size_t l = 0; l < log_segment::LEVELS; ++l)
+    {
+        const size_t level_size = storage.level_sizes[l];
+        if(level_size > (l == 0 ? size : storage.level_sizes[l - 1]))
+        {
+            return false;
+        }
+        const auto indexes = std::span(storage.level_indexes[l]).first(level_size);
+        if(std::ranges::any_of(indexes, [size](uint16_t i) noexcept { return i >= size; }))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t log_store_file::unused_slot() const noexcept
+{
+    // unused slots first, then the oldest content
+    size_t best = _slots;
+    uint64_t best_sequence = std::numeric_limits<uint64_t>::max();
+    for(size_t i = 0; i < _slots; ++i)
+    {
+        if(!_slot_segments[i].expired())
+        {
+            continue;
+        }
+        const uint64_t sequence = slot_valid(i) ? slot(i).first_sequence : 0;
+        if(best == _slots || sequence < best_sequence)
+        {
+            best = i;
+            best_sequence = sequence;
+        }
+    }
+    return best;
+}
+
+std::shared_ptr<log_segment> log_store_file::make_segment(size_t index)
+{
+    // the segment keeps the mapping alive
+    auto segment = std::make_shared<log_segment>(slot(index), shared_from_this());
+    _slot_segments[index] = segment;
+    _slot_copies[index] = false;
+    return segment;
+}
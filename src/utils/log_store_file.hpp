@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/log_segment.hpp>
+#include <utils/mapped_file.hpp>
+
+// external
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Memory mapped backing file of a store_sink: a header, the logger names, then fixed size segment slots.
+// Segments live directly in their slot, the next run adopts them as they are, without parsing.
+// Single writer: every non const function is for the sink writer only.
+class log_store_file final : public std::enable_shared_from_this<log_store_file>
+{
+public:
+    static constexpr size_t NAMES_SIZE = 64 * 1024;
+
+    // the content is discarded if the file was written with another layout or slot count
+    [[nodiscard]] static tl::expected<std::shared_ptr<log_store_file>, std::string>
+    open(const std::filesystem::path& path, size_t slots);
+
+    // use open()
+    log_store_file(mapped_file&& file, size_t slots) noexcept;
+    log_store_file(const log_store_file&) = delete;
+    log_store_file(log_store_file&&) = delete;
+    log_store_file& operator=(const log_store_file&) = delete;
+    log_store_file& operator=(log_store_file&&) = delete;
+    ~log_store_file() noexcept = default;
+
+    // logger names of the previous runs, indexed by logger id
+    [[nodiscard]] std::vector<std::string_view> restore_names() const;
+
+    // segments of the previous runs, the last max_segments of the most recent run of consecutive sequences
+    // slots inconsistent with their layout or with the names_count restored names are reset, not adopted
+    [[nodiscard]] std::vector<std::shared_ptr<log_segment>> restore_segments(size_t max_segments, size_t names_count);
+
+    // new segment in the slot with the oldest content not used by any segment, nullptr if all are used
+    [[nodiscard]] std::shared_ptr<log_segment> new_segment(uint64_t first_sequence);
+
+    // for segments allocated while all the slots were used: copy the records of a segment not backed by the file
+    // to its slot, taken as new_segment() does, return false if all are used
+    // the copy is only updated by the next calls
+    bool persist(const std::shared_ptr<const log_segment>& segment);
+
+    // drop the pages of a segment slot from memory, for segments not read anymore (e.g. compressed ones)
+    // the slot is then used by replacement
+    void release(const log_segment& segment, const std::shared_ptr<const log_segment>& replacement) noexcept;
+
+    // names have to be persisted in id order, return false once the names region is full
+    bool persist_name(uint16_t id, std::string_view name);
+
+    void flush() noexcept;
+
+private:
+    struct header
+    {
+        static constexpr uint64_t MAGIC = 0x31545347'4F4C5554; // "TULOGST1"
+
+        uint64_t magic;
+        uint64_t storage_size;
+        uint64_t slots;
+        uint32_t names_count;
+        uint32_t names_used;
+    };
+
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t NAMES_OFFSET = PAGE_SIZE;
+    static constexpr size_t SLOTS_OFFSET = NAMES_OFFSET + NAMES_SIZE;
+    static constexpr size_t SLOT_SIZE = (sizeof(log_segment::storage) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+    mapped_file _file;
+    size_t _slots;
+    std::vector<std::weak_ptr<const log_segment>> _slot_segments;
+    // the slot holds a copy of the records of its segment, see persist()
+    std::vector<bool> _slot_copies;
+
+    [[nodiscard]] header& file_header() const noexcept;
+    [[nodiscard]] log_segment::storage& slot(size_t index) const noexcept;
+    [[nodiscard]] bool slot_valid(size_t index) const noexcept;
+    [[nodiscard]] bool slot_consistent(size_t index, size_t names_count) const noexcept;
+    // slot with the oldest content not used by any segment, _slots if all are used
+    [[nodiscard]] size_t unused_slot() const noexcept;
+    [[nodiscard]] std::shared_ptr<log_segment> make_segment(size_t index);
+};
@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// C++ standard
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// ASCII case folding, used by the index and by the searches verifying its candidates
+[[nodiscard]] constexpr char fold_case(char c) noexcept
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Case insensitive trigram index of a sequence of records, immutable once built.
+// Records are grouped in blocks and trigrams hashed in buckets to keep the index small:
+// lookups return a superset of the blocks containing the pattern, which have to be verified.
+class trigram_index final
+{
+public:
+    static constexpr size_t BLOCK_RECORDS = 8;
+    static constexpr size_t BUCKET_BITS = 15;
+    static constexpr size_t BUCKETS = 1 << BUCKET_BITS;
+    static constexpr size_t MIN_PATTERN_SIZE = 3;
+
+    // text_at(i) returns the text of the record i, for i in [0, records)
+    template<typename TextAt>
+    trigram_index(size_t records, TextAt text_at);
+
+    // ordered blocks which may contain pattern, pattern must be at least MIN_PATTERN_SIZE long
+    [[nodiscard]] std::vector<uint16_t> candidates(std::string_view pattern) const;
+
+    [[nodiscard]] size_t memory_size() const noexcept;
+
+private:
+    std::vector<uint32_t> _offsets;
+    std::vector<uint16_t> _blocks;
+
+    // append the unique buckets of the trigrams of txt
+    static void add_buckets(std::string_view txt, std::vector<uint16_t>& buckets);
+};
+
+template<typename TextAt>
+trigram_index::trigram_index(size_t records, TextAt text_at) : _offsets(BUCKETS + 1, 0), _blocks()
+{
+    // unique buckets of each block, then counting sort of the (bucket, block) pairs by bucket
+    std::vector<uint16_t> blocks_buckets;
+    std::vector<uint32_t> blocks_offsets{0};
+    std::vector<uint16_t> block_buckets;
+    std::vector<bool> block_seen(BUCKETS, false);
+    for(size_t block_begin = 0; block_begin < records; block_begin += BLOCK_RECORDS)
+    {
+        block_buckets.clear();
+        for(size_t i = block_begin; i < std::min(block_begin + BLOCK_RECORDS, records); ++i)
+        {
+            add_buckets(text_at(i), block_buckets);
+        }
+        for(uint16_t bucket: block_buckets)
+        {
+            if(!block_seen[bucket])
+            {
+                block_seen[bucket] = true;
+                blocks_buckets.push_back(bucket);
+            }
+        }
+        for(uint16_t bucket: block_buckets)
+        {
+            block_seen[bucket] = false;
+        }
+        blocks_offsets.push_back(static_cast<uint32_t>(blocks_buckets.size()));
+    }
+
+    for(uint16_t bucket: blocks_buckets)
+    {
+        ++_offsets[bucket + 1];
+    }
+    for(size_t i = 1; i < _offsets.size(); ++i)
+    {
+        _offsets[i] += _offsets[i - 1];
+    }
+    _blocks.resize(blocks_buckets.size());
+    std::vector<uint32_t> cursors(_offsets.begin(), std::prev(_offsets.end()));
+    for(size_t block = 0; block + 1 < blocks_offsets.size(); ++block)
+    {
+        for(uint32_t i = blocks_offsets[block]; i < blocks_offsets[block + 1]; ++i)
+        {
+            _blocks[cursors[blocks_buckets[i]]++] = static_cast<uint16_t>(block);
+        }
+    }
+}
+
+inline std::vector<uint16_t> trigram_index::candidates(std::string_view pattern) const
+{
+    std::vector<uint16_t> buckets;
+    add_buckets(pattern, buckets);
+    std::ranges::sort(buckets);
+    const auto duplicates = std::ranges::unique(buckets);
+    buckets.erase(duplicates.begin(), duplicates.end());
+
+    // intersect the posting lists, smallest first
+    std::vector<std::span<const uint16_t>> postings;
+    postings.reserve(buckets.size());
+    for(uint16_t bucket: buckets)
+    {
+        postings.emplace_back(_blocks.data() + _offsets[bucket], _blocks.data() + _offsets[bucket + 1]);
+    }
+    std::ranges::sort(postings, {}, &std::span<const uint16_t>::size);
+
+    std::vector<uint16_t> result;
+    if(!postings.empty())
+    {
+        result.assign(postings.front().begin(), postings.front().end());
+        std::vector<uint16_t> intersection;
+        for(size_t i = 1; i < postings.size() && !result.empty(); ++i)
+        {
+            intersection.clear();
+            std::ranges::set_intersection(result, postings[i], std::back_inserter(intersection));
+            result.swap(intersection);
+        }
+    }
+    return result;
+}
+
+inline size_t trigram_index::memory_size() const noexcept
+{
+    return _offsets.capacity() * sizeof(uint32_t) + _blocks.capacity() * sizeof(uint16_t);
+}
+
+inline void trigram_index::add_buckets(std::string_view txt, std::vector<uint16_t>& buckets)
+{
+    for(size_t i = 0; i + MIN_PATTERN_SIZE <= txt.size(); ++i)
+    {
+        const uint32_t trigram = static_cast<uint32_t>(static_cast<unsigned char>(fold_case(txt[i]))) << 16
+                                 | static_cast<uint32_t>(static_cast<unsigned char>(fold_case(txt[i + 1]))) << 8
+                                 | static_cast<uint32_t>(static_cast<unsigned char>(fold_case(txt[i + 2])));
+        // Fibonacci hashing on the bucket bits
+        buckets.push_back(static_cast<uint16_t>((trigram * 2654435761u) >> (32 - BUCKET_BITS)));
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// C++ standard
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Append only table of logger names, stored logs refer to their logger by id.
+// Single writer, lock-free readers: names below size() never change.
+class logger_names final
+{
+public:
+    static constexpr size_t CAPACITY = 1024;
+
+    // shared by every logger past the capacity
+    static constexpr uint16_t OVERFLOW_ID = CAPACITY - 1;
+
+    logger_names();
+    logger_names(const logger_names&) = delete;
+    logger_names(logger_names&&) = delete;
+    logger_names& operator=(const logger_names&) = delete;
+    logger_names& operator=(logger_names&&) = delete;
+    ~logger_names() noexcept = default;
+
+    // writer only
+    [[nodiscard]] uint16_t intern(std::string_view name);
+
+    [[nodiscard]] std::string_view name(uint16_t id) const noexcept;
+    [[nodiscard]] size_t size() const noexcept;
+
+private:
+    std::unique_ptr<std::string[]> _names;
+    std::atomic<size_t> _size = 0;
+
+    // writer only, views on _names which never move
+    std::unordered_map<std::string_view, uint16_t> _ids;
+};
+
+inline logger_names::logger_names() : _names(std::make_unique<std::string[]>(CAPACITY)), _ids()
+{
+    _names[OVERFLOW_ID] = "...";
+}
+
+inline uint16_t logger_names::intern(std::string_view name)
+{
+    if(const auto it = _ids.find(name); it != _ids.end())
+    {
+        return it->second;
+    }
+    const size_t id = _size.load(std::memory_order_relaxed);
+    if(id == OVERFLOW_ID)
+    {
+        return OVERFLOW_ID;
+    }
+    _names[id] = name;
+    _ids.emplace(_names[id], static_cast<uint16_t>(id));
+    _size.store(id + 1, std::memory_order_release);
+    return static_cast<uint16_t>(id);
+}
+
+inline std::string_view logger_names::name(uint16_t id) const noexcept
+{
+    return _names[id];
+}
+
+inline size_t logger_names::size() const noexcept
+{
+    return _size.load(std::memory_order_acquire);
+}
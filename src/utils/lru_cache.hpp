@@ -0,0 +1,109 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// C++ standard
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Fixed capacity map evicting the least recently used entry.
+// Values are kept in a list ordered by use, the map points into it.
+template<typename Key, typename Value>
+class lru_cache final
+{
+public:
+    explicit lru_cache(size_t capacity);
+    lru_cache(const lru_cache&) = delete;
+    lru_cache(lru_cache&&) noexcept = default;
+    lru_cache& operator=(const lru_cache&) = delete;
+    lru_cache& operator=(lru_cache&&) noexcept = default;
+    ~lru_cache() noexcept = default;
+
+    [[nodiscard]] size_t size() const noexcept;
+    [[nodiscard]] size_t capacity() const noexcept;
+
+    // nullptr if missing, marks the entry as the most recently used
+    [[nodiscard]] Value* find(const Key& key);
+
+    // replaces the value of an existing entry, the returned reference is valid until the next insert or clear
+    Value& insert(const Key& key, Value value);
+
+    void clear() noexcept;
+
+private:
+    using entry = std::pair<Key, Value>;
+
+    size_t _capacity;
+    std::list<entry> _entries;
+    std::unordered_map<Key, typename std::list<entry>::iterator> _index;
+};
+
+template<typename Key, typename Value>
+lru_cache<Key, Value>::lru_cache(size_t capacity) : _capacity(capacity), _entries(), _index()
+{
+    assert(capacity > 0);
+    _index.reserve(capacity);
+}
+
+template<typename Key, typename Value>
+size_t lru_cache<Key, Value>::size() const noexcept
+{
+    return _entries.size();
+}
+
+template<typename Key, typename Value>
+size_t lru_cache<Key, Value>::capacity() const noexcept
+{
+    return _capacity;
+}
+
+template<typename Key, typename Value>
+Value* lru_cache<Key, Value>::find(const Key& key)
+{
+    const auto it = _index.find(key);
+    if(it == _index.end())
+    {
+        return nullptr;
+    }
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return &it->second->second;
+}
+
+template<typename Key, typename Value>
+Value& lru_cache<Key, Value>::insert(const Key& key, Value value)
+{
+    if(Value* existing = find(key))
+    {
+        *existing = std::move(value);
+        return *existing;
+    }
+    if(_entries.size() == _capacity)
+    {
+        // reuse the least recently used node
+        _index.erase(_entries.back().first);
+        _entries.splice(_entries.begin(), _entries, std::prev(_entries.end()));
+        _entries.front() = entry(key, std::move(value));
+    }
+    else
+    {
+        _entries.emplace_front(key, std::move(value));
+    }
+    _index.emplace(key, _entries.begin());
+    return _entries.front().second;
+}
+
+template<typename Key, typename Value>
+void lru_cache<Key, Value>::clear() noexcept
+{
+    _entries.clear();
+    _index.clear();
+}
@@ -0,0 +1,207 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "mapped_file.hpp"
+
+// project
+#include <utils/path_utils.hpp>
+
+// external
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/file.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+// C++ standard
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+tl::expected<mapped_file, std::string> mapped_file::open(const std::filesystem::path& path, size_t size)
+{
+    const std::string path_str = path_to_generic_utf8_string(path);
+    mapped_file file;
+    file._size = size;
+#if defined(_WIN32)
+    file._file = CreateFileW(path.c_str(),
+                             GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ,
+                             nullptr,
+                             OPEN_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL,
+                             nullptr);
+    if(file._file == INVALID_HANDLE_VALUE)
+    {
+        file._file = nullptr;
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to open {}: error {}"), path_str, GetLastError()));
+    }
+    LARGE_INTEGER file_size;
+    file_size.QuadPart = static_cast<LONGLONG>(size);
+    if(!SetFilePointerEx(file._file, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(file._file))
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to resize {}: error {}"), path_str, GetLastError()));
+    }
+    file._mapping = CreateFileMappingW(file._file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if(file._mapping == nullptr)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to map {}: error {}"), path_str, GetLastError()));
+    }
+    file._data = static_cast<std::byte*>(MapViewOfFile(file._mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if(file._data == nullptr)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to map {}: error {}"), path_str, GetLastError()));
+    }
+#else
+    file._file = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(file._file < 0)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to open {}: {}"), path_str, std::strerror(errno)));
+    }
+    // exclusive, as the Windows sharing mode: another process writing the mapping would corrupt it
+    if(::flock(file._file, LOCK_EX | LOCK_NB) != 0)
+    {
+        if(errno == EWOULDBLOCK)
+        {
+            return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is used by another process"), path_str));
+        }
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to lock {}: {}"), path_str, std::strerror(errno)));
+    }
+    if(::ftruncate(file._file, static_cast<off_t>(size)) != 0)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to resize {}: {}"), path_str, std::strerror(errno)));
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file._file, 0);
+    if(data == MAP_FAILED)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to map {}: {}"), path_str, std::strerror(errno)));
+    }
+    file._data = static_cast<std::byte*>(data);
+#endif
+    return file;
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : _data(std::exchange(other._data, nullptr))
+    , _size(std::exchange(other._size, 0))
+#if defined(_WIN32)
+    , _file(std::exchange(other._file, nullptr))
+    , _mapping(std::exchange(other._mapping, nullptr))
+#else
+    , _file(std::exchange(other._file, -1))
+#endif
+{
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if(this != &other)
+    {
+        close();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+#if defined(_WIN32)
+        _file = std::exchange(other._file, nullptr);
+        _mapping = std::exchange(other._mapping, nullptr);
+#else
+        _file = std::exchange(other._file, -1);
+#endif
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() noexcept
+{
+    close();
+}
+
+std::byte* mapped_file::data() const noexcept
+{
+    return _data;
+}
+
+size_t mapped_file::size() const noexcept
+{
+    return _size;
+}
+
+void mapped_file::flush() noexcept
+{
+    if(_data == nullptr)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    FlushViewOfFile(_data, 0);
+#else
+    ::msync(_data, _size, MS_ASYNC);
+#endif
+}
+
+void mapped_file::discard(size_t offset, size_t size) noexcept
+{
+    if(_data == nullptr || offset >= _size)
+    {
+        return;
+    }
+    size = std::min(size, _size - offset);
+#if defined(_WIN32)
+    // unlocking pages which are not locked removes them from the working set
+    VirtualUnlock(_data + offset, size);
+#else
+    // the mapping start is page aligned, only the whole pages of the range are dropped
+    const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t begin = (offset + page_size - 1) / page_size * page_size;
+    const size_t end = (offset + size) / page_size * page_size;
+    if(begin < end)
+    {
+        ::madvise(_data + begin, end - begin, MADV_DONTNEED);
+    }
+#endif
+}
+
+void mapped_file::close() noexcept
+{
+#if defined(_WIN32)
+    if(_data != nullptr)
+    {
+        UnmapViewOfFile(_data);
+    }
+    if(_mapping != nullptr)
+    {
+        CloseHandle(_mapping);
+    }
+    if(_file != nullptr)
+    {
+        CloseHandle(_file);
+    }
+    _mapping = nullptr;
+    _file = nullptr;
+#else
+    if(_data != nullptr)
+    {
+        ::munmap(_data, _size);
+    }
+    if(_file >= 0)
+    {
+        ::close(_file);
+    }
+    _file = -1;
+#endif
+    _data = nullptr;
+    _size = 0;
+}
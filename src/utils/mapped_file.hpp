@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// external
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+// Read-write shared mapping of a whole file, the OS page cache handles the paging.
+class mapped_file final
+{
+public:
+    // open or create path, resized to size bytes (new bytes are zeroed)
+    // the file is locked until closed: fails while another mapped_file, in any process, has it open
+    [[nodiscard]] static tl::expected<mapped_file, std::string> open(const std::filesystem::path& path, size_t size);
+
+    mapped_file() noexcept = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file() noexcept;
+
+    [[nodiscard]] std::byte* data() const noexcept;
+    [[nodiscard]] size_t size() const noexcept;
+
+    // schedule the write back of the modified pages, without waiting for it
+    void flush() noexcept;
+
+    // drop the whole pages of the range from the process memory, they are read back from the file on access
+    void discard(size_t offset, size_t size) noexcept;
+
+private:
+    std::byte* _data = nullptr;
+    size_t _size = 0;
+#if defined(_WIN32)
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#else
+    int _file = -1;
+#endif
+
+    void close() noexcept;
+};
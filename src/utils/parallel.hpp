@@ -0,0 +1,286 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/thread_pool.hpp>
+
+// C++ standard
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace details
+{
+    // Shared chunk dispenser, chunks shrink as the remaining range gets smaller (guided scheduling)
+    template<std::integral Index>
+    class chunked_range final
+    {
+    public:
+        chunked_range(Index begin, Index end, Index grain, size_t participants) noexcept;
+
+        [[nodiscard]] bool claim(Index& chunk_begin, Index& chunk_end) noexcept;
+        void complete(size_t count) noexcept;
+        void fail(std::exception_ptr exception) noexcept;
+        [[nodiscard]] bool failed() const noexcept;
+
+        // block until every claimed chunk is completed, rethrow the first failure
+        void join();
+
+    private:
+        std::atomic<Index> _next;
+        const Index _end;
+        const Index _grain;
+        const size_t _participants;
+        const size_t _total;
+        std::atomic<size_t> _done = 0;
+        std::atomic<bool> _failed = false;
+        std::once_flag _failure_flag{};
+        std::exception_ptr _failure{};
+    };
+
+    template<std::integral Index>
+    [[nodiscard]] size_t helpers_count(const thread_pool& pool, Index begin, Index end, Index grain) noexcept;
+
+    template<std::integral Index, typename Func>
+    void invoke_chunk(Func& func, Index chunk_begin, Index chunk_end);
+} // namespace details
+
+// Run func over [begin, end), split in chunks of at least grain elements.
+// func is invoked either as func(chunk_begin, chunk_end) or as func(i) for each index.
+// The calling thread executes chunks too and returns once all of them are done.
+template<std::integral Index, typename Func>
+void parallel_for(thread_pool& pool, Index begin, Index end, Index grain, Func&& func);
+
+// Run func on each element of a random access range
+template<std::ranges::random_access_range Range, typename Func>
+void parallel_for(thread_pool& pool, Range&& range, size_t grain, Func&& func);
+
+// Reduce [begin, end): map(chunk_begin, chunk_end) produces a partial result per chunk,
+// partial results are combined with reduce(T, T) which must be associative and commutative.
+template<std::integral Index, typename T, typename Map, typename Reduce>
+[[nodiscard]] T
+parallel_reduce(thread_pool& pool, Index begin, Index end, Index grain, T identity, Map&& map, Reduce&& reduce);
+
+template<std::integral Index>
+details::chunked_range<Index>::chunked_range(Index begin, Index end, Index grain, size_t participants) noexcept
+    : _next(begin)
+    , _end(end)
+    , _grain(std::max(grain, static_cast<Index>(1)))
+    , _participants(std::max(participants, static_cast<size_t>(1)))
+    , _total(begin < end ? static_cast<size_t>(end - begin) : 0)
+{
+}
+
+template<std::integral Index>
+bool details::chunked_range<Index>::claim(Index& chunk_begin, Index& chunk_end) noexcept
+{
+    Index next = _next.load(std::memory_order_relaxed);
+    while(next < _end)
+    {
+        // computed unsigned, next < _end so the remaining count fits
+        const auto remaining = static_cast<size_t>(_end - next);
+        const auto guided = remaining / (2 * _participants);
+        const auto size = static_cast<Index>(std::min(remaining, std::max(static_cast<size_t>(_grain), guided)));
+        if(_next.compare_exchange_weak(next, next + size, std::memory_order_relaxed))
+        {
+            chunk_begin = next;
+            chunk_end = next + size;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<std::integral Index>
+void details::chunked_range<Index>::complete(size_t count) noexcept
+{
+    if(count != 0)
+    {
+        _done.fetch_add(count, std::memory_order_acq_rel);
+        _done.notify_all();
+    }
+}
+
+template<std::integral Index>
+void details::chunked_range<Index>::fail(std::exception_ptr exception) noexcept
+{
+    std::call_once(_failure_flag, [&]() noexcept { _failure = std::move(exception); });
+    _failed.store(true, std::memory_order_release);
+}
+
+template<std::integral Index>
+bool details::chunked_range<Index>::failed() const noexcept
+{
+    return _failed.load(std::memory_order_acquire);
+}
+
+template<std::integral Index>
+void details::chunked_range<Index>::join()
+{
+    size_t done = _done.load(std::memory_order_acquire);
+    while(done != _total)
+    {
+        _done.wait(done, std::memory_order_acquire);
+        done = _done.load(std::memory_order_acquire);
+    }
+    if(_failed.load(std::memory_order_acquire))
+    {
+        std::rethrow_exception(_failure);
+    }
+}
+
+template<std::integral Index>
+size_t details::helpers_count(const thread_pool& pool, Index begin, Index end, Index grain) noexcept
+{
+    if(end <= begin)
+    {
+        return 0;
+    }
+    const size_t size = static_cast<size_t>(end - begin);
+    const size_t chunk = static_cast<size_t>(std::max(grain, static_cast<Index>(1)));
+    const size_t chunks = (size + chunk - 1) / chunk;
+    return std::min(pool.thread_number(), chunks - 1);
+}
+
+template<std::integral Index, typename Func>
+void details::invoke_chunk(Func& func, Index chunk_begin, Index chunk_end)
+{
+    if constexpr(std::is_invocable_v<Func&, Index, Index>)
+    {
+        std::invoke(func, chunk_begin, chunk_end);
+    }
+    else
+    {
+        for(Index i = chunk_begin; i < chunk_end; ++i)
+        {
+            std::invoke(func, i);
+        }
+    }
+}
+
+template<std::integral Index, typename Func>
+void parallel_for(thread_pool& pool, Index begin, Index end, Index grain, Func&& func)
+{
+    const size_t helpers = details::helpers_count(pool, begin, end, grain);
+    auto range = std::make_shared<details::chunked_range<Index>>(begin, end, grain, helpers + 1);
+
+    // helpers only touch func after a successful claim, which join() waits for
+    auto run = [](details::chunked_range<Index>& chunks, std::remove_reference_t<Func>& body) noexcept
+    {
+        Index chunk_begin, chunk_end;
+        while(chunks.claim(chunk_begin, chunk_end))
+        {
+            if(!chunks.failed())
+            {
+                try
+                {
+                    details::invoke_chunk(body, chunk_begin, chunk_end);
+                }
+                catch(...)
+                {
+                    chunks.fail(std::current_exception());
+                }
+            }
+            chunks.complete(static_cast<size_t>(chunk_end - chunk_begin));
+        }
+    };
+    for(size_t i = 0; i < helpers; ++i)
+    {
+        pool.exec([range, run, &func]() noexcept { run(*range, func); });
+    }
+    run(*range, func);
+    range->join();
+}
+
+template<std::ranges::random_access_range Range, typename Func>
+void parallel_for(thread_pool& pool, Range&& range, size_t grain, Func&& func)
+{
+    using difference_t = std::ranges::range_difference_t<Range>;
+    auto first = std::ranges::begin(range);
+    parallel_for(pool,
+                 static_cast<size_t>(0),
+                 static_cast<size_t>(std::ranges::distance(range)),
+                 grain,
+                 [&first, &func](size_t i) { std::invoke(func, first[static_cast<difference_t>(i)]); });
+}
+
+template<std::integral Index, typename T, typename Map, typename Reduce>
+T parallel_reduce(thread_pool& pool, Index begin, Index end, Index grain, T identity, Map&& map, Reduce&& reduce)
+{
+    struct reduce_state
+    {
+        details::chunked_range<Index> chunks;
+        std::mutex mutex{};
+        T result;
+
+        reduce_state(Index begin_, Index end_, Index grain_, size_t participants, T&& identity_) noexcept(
+          std::is_nothrow_move_constructible_v<T>)
+            : chunks(begin_, end_, grain_, participants)
+            , result(std::move(identity_))
+        {
+        }
+    };
+
+    const size_t helpers = details::helpers_count(pool, begin, end, grain);
+    auto state = std::make_shared<reduce_state>(begin, end, grain, helpers + 1, std::move(identity));
+
+    // partial results are merged before the processed count is published, so join() sees them
+    auto run = [](reduce_state& shared, auto& mapper, auto& reducer) noexcept
+    {
+        std::optional<T> partial;
+        size_t processed = 0;
+        Index chunk_begin, chunk_end;
+        while(shared.chunks.claim(chunk_begin, chunk_end))
+        {
+            if(!shared.chunks.failed())
+            {
+                try
+                {
+                    T chunk_result = std::invoke(mapper, chunk_begin, chunk_end);
+                    partial = partial ? std::invoke(reducer, std::move(*partial), std::move(chunk_result))
+                                      : std::move(chunk_result);
+                }
+                catch(...)
+                {
+                    shared.chunks.fail(std::current_exception());
+                }
+            }
+            processed += static_cast<size_t>(chunk_end - chunk_begin);
+        }
+        if(partial && !shared.chunks.failed())
+        {
+            try
+            {
+                const std::scoped_lock lock(shared.mutex);
+                shared.result = std::invoke(reducer, std::move(shared.result), std::move(*partial));
+            }
+            catch(...)
+            {
+                shared.chunks.fail(std::current_exception());
+            }
+        }
+        shared.chunks.complete(processed);
+    };
+    for(size_t i = 0; i < helpers; ++i)
+    {
+        pool.exec([state, run, &map, &reduce]() noexcept { run(*state, map, reduce); });
+    }
+    run(*state, map, reduce);
+    state->chunks.join();
+    return std::move(state->result);
+}
@@ -7,43 +7,95 @@
 //
 #pragma once
 
+// project
+#include <utils/log_segment.hpp>
+#include <utils/log_snapshot.hpp>
+#include <utils/log_store_file.hpp>
+#include <utils/logger_names.hpp>
+#include <utils/thread_pool.hpp>
+
 // external
 #include <spdlog/details/null_mutex.h>
-#include <spdlog/pattern_formatter.h>
 #include <spdlog/sinks/base_sink.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
+#include <tl/expected.hpp>
 
 // C++ standard
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <memory>
 #include <mutex>
-#include <thread>
+#include <string>
+#include <utility>
+#include <vector>
 
+// Number of logs received by level during one second
+struct log_rate_bucket
+{
+    std::chrono::sys_seconds second;
+    std::array<uint32_t, spdlog::level::n_levels> counts;
+};
+
+// Stores the raw logs fields in fixed size segments, the oldest segment is evicted when the capacity is reached.
+// Readers take snapshots and never hold the sink mutex while reading.
+// The segment list is immutable once published, so taking a snapshot only copies a pointer.
+// Sealed segments older than a hot tail can be compressed in background, they are cold.
+// With a compression pool, the search index of a segment is also built in background when it is sealed.
 template<typename Mutex>
-class store_sink final : public spdlog::sinks::base_sink<Mutex>
+class store_sink final
+    : public spdlog::sinks::base_sink<Mutex>
+    , public std::enable_shared_from_this<store_sink<Mutex>>
 {
 public:
-    struct store_log final
-    {
-        spdlog::level::level_enum level;
-        std::string txt;
-        size_t color_range_start;
-        size_t color_range_end;
-
-        store_log(spdlog::level::level_enum level,
-                  const std::string& txt,
-                  size_t color_range_start,
-                  size_t color_range_end) noexcept;
-        store_log(spdlog::level::level_enum level,
-                  std::string&& txt,
-                  size_t color_range_start,
-                  size_t color_range_end) noexcept;
+    using store_log = ::store_log;
+
+    static constexpr size_t MAX_RATE_BUCKETS = 24 * 60 * 60;
+
+    struct memory_usage
+    {
+        size_t hot_bytes;
+        size_t cold_bytes;
+        // size of the cold records before compression
+        size_t cold_records_bytes;
     };
 
-    store_sink() = default;
+    // capacity in MiB, 0 for unbounded: as many segments as fit in it are kept, two at least
+    explicit store_sink(size_t capacity_mb = 0);
     store_sink(const store_sink&) = delete;
     store_sink(store_sink&&) = delete;
     store_sink& operator=(const store_sink&) = delete;
     store_sink& operator=(store_sink&&) = delete;
-    ~store_sink() = default;
+    ~store_sink() override;
+
+    // the requested capacity, or the memory of the two segments kept at least rounded up to the MiB if larger
+    [[nodiscard]] size_t capacity_mb() const noexcept;
+
+    // back the segments with a memory mapped file and restore the logs it holds, before any log is stored
+    // bounded capacity only, return the number of restored logs
+    [[nodiscard]] tl::expected<size_t, std::string> open_file(const std::filesystem::path& path);
+
+    // compress the sealed segments but the last hot_count ones on pool and index the segments sealed from now on,
+    // nullptr to stop
+    // the sink must be owned by a shared_ptr, pool must outlive the compressions already submitted
+    void compress_cold_segments(thread_pool* pool, size_t hot_count = 2);
+
+    [[nodiscard]] memory_usage memory();
+
+    // logs received per second, from the since second onwards, counted when received (only the last
+    // MAX_RATE_BUCKETS seconds with logs are kept)
+    [[nodiscard]] std::vector<log_rate_bucket> log_rate(std::chrono::sys_seconds since);
+
+    // number of logs received at exactly this level, evicted ones included
+    [[nodiscard]] uint64_t level_count(spdlog::level::level_enum level) const noexcept;
+
+    // stable view on the logs stored up to now, starting from from_sequence
+    // (use the end_sequence() of a previous snapshot to get only the logs appended since)
+    [[nodiscard]] log_snapshot snapshot(uint64_t from_sequence = 0);
 
     template<typename T>
     void iterate_on_logs(T callable);
@@ -53,62 +105,415 @@ protected:
     void flush_() override;
 
 private:
-    std::vector<store_log> logs;
-    std::unique_ptr<spdlog::pattern_formatter> formatter = std::make_unique<spdlog::pattern_formatter>();
+    // memory of a hot segment: records, level indexes and arena
+    static constexpr size_t SEGMENT_SIZE = sizeof(log_segment::storage);
+
+    const size_t requested_capacity_mb;
+    const size_t max_segments;
+
+    // only locked to publish a new segment list or to copy its pointer
+    Mutex segments_mutex;
+    std::shared_ptr<const log_segment_list> segments = std::make_shared<const log_segment_list>();
+    std::shared_ptr<logger_names> names = std::make_shared<logger_names>();
+    std::shared_ptr<log_store_file> file;
+    uint64_t next_sequence = 0;
+    std::array<std::atomic<uint64_t>, spdlog::level::n_levels> level_counts{};
+    thread_pool* compression_pool = nullptr;
+    size_t hot_segments = 0;
+    // allocated while all the file slots were used, copied to the file once sealed or when flushed
+    std::vector<std::weak_ptr<const log_segment>> unsaved_segments;
+
+    // ordered by second, guarded by the sink mutex
+    std::deque<log_rate_bucket> rate_buckets;
+
+    void add_segment();
+    void save_segments(bool written);
+    void count_rate(std::chrono::system_clock::time_point time, spdlog::level::level_enum level);
+    // background tasks don't keep their segment: an evicted segment gives its file slot back
+    void submit_indexing(std::weak_ptr<const log_segment> segment);
+    void submit_compression(std::weak_ptr<log_segment> segment);
+    [[nodiscard]] bool sealed(const log_segment& segment);
+    void replace_segment(const log_segment& segment, std::shared_ptr<log_segment> compressed);
 };
 
 using store_sink_mt = store_sink<std::mutex>;
 using store_sink_st = store_sink<spdlog::details::null_mutex>;
 
 template<typename Mutex>
-store_sink<Mutex>::store_log::store_log(spdlog::level::level_enum level_,
-                                        const std::string& txt_,
-                                        size_t color_range_start_,
-                                        size_t color_range_end_) noexcept
-    : level(level_)
-    , txt(txt_)
-    , color_range_start(color_range_start_)
-    , color_range_end(color_range_end_)
+store_sink<Mutex>::store_sink(size_t capacity_mb)
+    : requested_capacity_mb(capacity_mb)
+    , max_segments(capacity_mb == 0 ? 0 : std::max<size_t>(2, capacity_mb * 1024 * 1024 / SEGMENT_SIZE))
+{
+}
+
+template<typename Mutex>
+store_sink<Mutex>::~store_sink()
 {
+    if(file)
+    {
+        save_segments(true);
+    }
 }
 
 template<typename Mutex>
-store_sink<Mutex>::store_log::store_log(spdlog::level::level_enum level_,
-                                        std::string&& txt_,
-                                        size_t color_range_start_,
-                                        size_t color_range_end_) noexcept
-    : level(level_)
-    , txt(txt_)
-    , color_range_start(color_range_start_)
-    , color_range_end(color_range_end_)
+size_t store_sink<Mutex>::capacity_mb() const noexcept
 {
+    // the segments fit in the requested capacity, unless below the minimum
+    static constexpr size_t MIB = 1024 * 1024;
+    return std::max(requested_capacity_mb, (max_segments * SEGMENT_SIZE + MIB - 1) / MIB);
 }
 
 template<typename Mutex>
-template<typename T>
-void store_sink<Mutex>::iterate_on_logs(T callable)
+tl::expected<size_t, std::string> store_sink<Mutex>::open_file(const std::filesystem::path& path)
 {
-    std::lock_guard<Mutex> lock(spdlog::sinks::base_sink<Mutex>::mutex_);
-    for(const auto& log: logs)
+    std::lock_guard<Mutex> lock(this->mutex_);
+    if(max_segments == 0 || next_sequence != 0 || file)
     {
-        if(!callable(log))
+        return tl::make_unexpected(std::string("store file requires a bounded and empty store"));
+    }
+    // two spare slots: the segment being written while the oldest is still held by a snapshot
+    tl::expected<std::shared_ptr<log_store_file>, std::string> opened = log_store_file::open(path, max_segments + 2);
+    if(!opened)
+    {
+        return tl::make_unexpected(std::move(opened.error()));
+    }
+    file = std::move(*opened);
+
+    // interned in the same order, the restored records keep their logger ids
+    // up to the first name not getting its id back (duplicated, past the capacity): later ids are not restored
+    size_t names_count = 0;
+    for(std::string_view name: file->restore_names())
+    {
+        if(names_count == logger_names::OVERFLOW_ID || names->intern(name) != names_count)
         {
             break;
         }
+        ++names_count;
+    }
+
+    auto list = std::make_shared<log_segment_list>();
+    for(std::shared_ptr<log_segment>& segment: file->restore_segments(max_segments, names_count))
+    {
+        // level index L holds the records at level >= L
+        for(size_t level = 0; level < spdlog::level::n_levels; ++level)
+        {
+            const auto min_level = static_cast<spdlog::level::level_enum>(level);
+            const size_t above = level + 1 < spdlog::level::n_levels
+                                 ? segment->level_indexes(static_cast<spdlog::level::level_enum>(level + 1)).size()
+                                 : 0;
+            level_counts[level].fetch_add(segment->level_indexes(min_level).size() - above, std::memory_order_relaxed);
+        }
+        for(size_t i = 0; i < segment->size(); ++i)
+        {
+            const store_log log = segment->at(i);
+            count_rate(log.time, log.level);
+        }
+        list->push_back(std::move(segment));
+    }
+    const size_t restored = list->empty() ? 0 : list->back()->end_sequence() - list->front()->first_sequence();
+    next_sequence = list->empty() ? 0 : list->back()->end_sequence();
+
+    std::lock_guard<Mutex> segments_lock(segments_mutex);
+    segments = std::move(list);
+    return restored;
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::compress_cold_segments(thread_pool* pool, size_t hot_count)
+{
+    std::lock_guard<Mutex> lock(this->mutex_);
+    compression_pool = pool;
+    // the last segment is still written
+    hot_segments = std::max<size_t>(1, hot_count);
+    if(compression_pool != nullptr && segments->size() > hot_segments)
+    {
+        for(auto it = segments->begin(); it != std::prev(segments->end(), static_cast<ptrdiff_t>(hot_segments)); ++it)
+        {
+            if(!(*it)->compressed())
+            {
+                submit_compression(*it);
+            }
+        }
     }
 }
 
+template<typename Mutex>
+typename store_sink<Mutex>::memory_usage store_sink<Mutex>::memory()
+{
+    std::shared_ptr<const log_segment_list> list;
+    {
+        std::lock_guard<Mutex> lock(segments_mutex);
+        list = segments;
+    }
+    memory_usage usage{};
+    for(const std::shared_ptr<log_segment>& segment: *list)
+    {
+        if(segment->compressed())
+        {
+            usage.cold_bytes += segment->memory_size();
+            usage.cold_records_bytes += segment->records_size();
+        }
+        else
+        {
+            usage.hot_bytes += segment->memory_size();
+        }
+    }
+    return usage;
+}
+
+template<typename Mutex>
+std::vector<log_rate_bucket> store_sink<Mutex>::log_rate(std::chrono::sys_seconds since)
+{
+    std::lock_guard<Mutex> lock(this->mutex_);
+    const auto first = std::ranges::lower_bound(rate_buckets, since, {}, &log_rate_bucket::second);
+    return {first, rate_buckets.end()};
+}
+
+template<typename Mutex>
+uint64_t store_sink<Mutex>::level_count(spdlog::level::level_enum level) const noexcept
+{
+    return level_counts[static_cast<size_t>(level)].load(std::memory_order_relaxed);
+}
+
+template<typename Mutex>
+template<typename T>
+void store_sink<Mutex>::iterate_on_logs(T callable)
+{
+    snapshot().iterate_on_logs(std::move(callable));
+}
+
 template<typename Mutex>
 void store_sink<Mutex>::sink_it_(const spdlog::details::log_msg& msg)
 {
-    spdlog::memory_buf_t formatted;
-    formatter->format(msg, formatted);
-    logs.emplace_back(
-      msg.level, std::string(formatted.data(), formatted.size()), msg.color_range_start, msg.color_range_end);
-    auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    // no formatting on the logging thread, the records are formatted by their readers
+    const std::string_view payload(msg.payload.data(), msg.payload.size());
+    const auto thread_id = static_cast<uint32_t>(msg.thread_id);
+    const std::string_view logger_name(msg.logger_name.data(), msg.logger_name.size());
+    const size_t names_count = names->size();
+    const uint16_t logger_id = names->intern(logger_name);
+    if(file && names->size() != names_count)
+    {
+        file->persist_name(logger_id, logger_name);
+    }
+    // only the writer replaces the list, no need to lock to read it
+    if(segments->empty() || !segments->back()->append(msg.level, msg.time, thread_id, logger_id, payload))
+    {
+        add_segment();
+        [[maybe_unused]] const bool appended =
+          segments->back()->append(msg.level, msg.time, thread_id, logger_id, payload);
+        assert(appended);
+    }
+    ++next_sequence;
+    level_counts[static_cast<size_t>(msg.level)].fetch_add(1, std::memory_order_relaxed);
+    count_rate(msg.time, msg.level);
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::count_rate(std::chrono::system_clock::time_point time, spdlog::level::level_enum level)
+{
+    const auto second = std::chrono::floor<std::chrono::seconds>(time);
+    if(rate_buckets.empty() || rate_buckets.back().second < second)
+    {
+        rate_buckets.push_back({second, {}});
+        if(rate_buckets.size() > MAX_RATE_BUCKETS)
+        {
+            rate_buckets.pop_front();
+        }
+    }
+    auto bucket = std::prev(rate_buckets.end());
+    if(bucket->second != second)
+    {
+        // records are timed before being queued, they can be received slightly out of order
+        bucket = std::ranges::lower_bound(rate_buckets, second, {}, &log_rate_bucket::second);
+        if(bucket->second != second)
+        {
+            if(bucket == rate_buckets.begin() && rate_buckets.size() == MAX_RATE_BUCKETS)
+            {
+                // older than the kept seconds
+                return;
+            }
+            bucket = rate_buckets.insert(bucket, {second, {}});
+        }
+    }
+    ++bucket->counts[static_cast<size_t>(level)];
 }
 
 template<typename Mutex>
 void store_sink<Mutex>::flush_()
 {
+    if(file)
+    {
+        save_segments(true);
+        file->flush();
+    }
+}
+
+template<typename Mutex>
+log_snapshot store_sink<Mutex>::snapshot(uint64_t from_sequence)
+{
+    std::shared_ptr<const log_segment_list> list;
+    {
+        std::lock_guard<Mutex> lock(segments_mutex);
+        list = segments;
+    }
+    return log_snapshot(std::move(list), names, from_sequence);
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::add_segment()
+{
+    auto list = std::make_shared<log_segment_list>();
+    list->reserve(segments->size() + 1);
+    auto first = segments->begin();
+
+    // snapshots copy the published list under this lock: the use counts can not grow while it is held
+    std::lock_guard<Mutex> lock(segments_mutex);
+    std::shared_ptr<log_segment> segment;
+    if(max_segments != 0 && segments->size() >= max_segments)
+    {
+        // evict the oldest segment, recycle its memory if no snapshot holds it
+        // (with a file, its slot is taken by the new segment once released)
+        if(!file && segments.use_count() == 1 && first->use_count() == 1 && !(*first)->compressed())
+        {
+            segment = *first;
+            segment->reset(next_sequence);
+        }
+        ++first;
+    }
+    if(!segment && file)
+    {
+        segment = file->new_segment(next_sequence);
+        if(!segment)
+        {
+            // the slots are still used by evicted segments, held by snapshots or background tasks
+            segment = std::make_shared<log_segment>(next_sequence);
+            unsaved_segments.push_back(segment);
+        }
+    }
+    if(!segment)
+    {
+        segment = std::make_shared<log_segment>(next_sequence);
+    }
+    list->assign(first, segments->end());
+    list->push_back(std::move(segment));
+    segments = std::move(list);
+    if(!unsaved_segments.empty())
+    {
+        save_segments(false);
+    }
+
+    if(compression_pool != nullptr && segments->size() > 1)
+    {
+        submit_indexing((*segments)[segments->size() - 2]);
+    }
+    if(compression_pool != nullptr && segments->size() > hot_segments)
+    {
+        const std::shared_ptr<log_segment>& sealed = (*segments)[segments->size() - 1 - hot_segments];
+        if(!sealed->compressed())
+        {
+            submit_compression(sealed);
+        }
+    }
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::save_segments(bool written)
+{
+    // in the oldest slots released since: the evicted segments are not saved anymore
+    std::erase_if(unsaved_segments,
+                  [this, written](const std::weak_ptr<const log_segment>& weak_segment)
+                  {
+                      const std::shared_ptr<const log_segment> segment = weak_segment.lock();
+                      const auto it = std::ranges::find(*segments, segment.get(), &std::shared_ptr<log_segment>::get);
+                      if(!segment || it == segments->end())
+                      {
+                          return true;
+                      }
+                      if(std::next(it) == segments->end())
+                      {
+                          // still written, saved again once sealed
+                          if(written)
+                          {
+                              [[maybe_unused]] const bool saved = file->persist(segment);
+                          }
+                          return false;
+                      }
+                      return file->persist(segment);
+                  });
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::submit_indexing(std::weak_ptr<const log_segment> segment)
+{
+    [[maybe_unused]] task_future<void> indexing = compression_pool->submit(
+      thread_pool::priority::background,
+      [weak_sink = this->weak_from_this(), weak_segment = std::move(segment)]()
+      {
+          const std::shared_ptr<store_sink> locked_sink = weak_sink.lock();
+          const std::shared_ptr<const log_segment> locked_segment = weak_segment.lock();
+          if(locked_sink && locked_segment && locked_sink->sealed(*locked_segment))
+          {
+              // held, it can't be recycled anymore: sealed segments are indexed without any lock
+              [[maybe_unused]] const trigram_index& index = locked_segment->search_index();
+          }
+      });
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::submit_compression(std::weak_ptr<log_segment> segment)
+{
+    [[maybe_unused]] task_future<void> compression = compression_pool->submit(
+      thread_pool::priority::background,
+      [weak_sink = this->weak_from_this(), weak_segment = std::move(segment)]()
+      {
+          const std::shared_ptr<store_sink> locked_sink = weak_sink.lock();
+          const std::shared_ptr<log_segment> locked_segment = weak_segment.lock();
+          if(locked_sink && locked_segment && locked_sink->sealed(*locked_segment))
+          {
+              // sealed segments are immutable, compressed without any lock
+              // indexed first if not done yet, the compressed copy keeps the index
+              [[maybe_unused]] const trigram_index& index = locked_segment->search_index();
+              locked_sink->replace_segment(*locked_segment, locked_segment->compress());
+          }
+      });
+}
+
+template<typename Mutex>
+bool store_sink<Mutex>::sealed(const log_segment& segment)
+{
+    // evicted meanwhile, or recycled as the written segment before being locked
+    std::lock_guard<Mutex> lock(this->mutex_);
+    const auto it = std::ranges::find(*segments, &segment, &std::shared_ptr<log_segment>::get);
+    return it != segments->end() && std::next(it) != segments->end();
+}
+
+template<typename Mutex>
+void store_sink<Mutex>::replace_segment(const log_segment& segment, std::shared_ptr<log_segment> compressed)
+{
+    // same lock as the writer: the list is only replaced by its holder
+    std::lock_guard<Mutex> lock(this->mutex_);
+    const auto it = std::ranges::find(*segments, &segment, &std::shared_ptr<log_segment>::get);
+    if(it == segments->end())
+    {
+        // evicted meanwhile
+        return;
+    }
+    auto list = std::make_shared<log_segment_list>(*segments);
+    (*list)[static_cast<size_t>(it - segments->begin())] = compressed;
+    {
+        std::lock_guard<Mutex> segments_lock(segments_mutex);
+        segments = std::move(list);
+    }
+    // snapshots still holding the segment read its pages back from the file
+    if(file)
+    {
+        file->release(segment, compressed);
+        for(std::weak_ptr<const log_segment>& unsaved: unsaved_segments)
+        {
+            if(unsaved.lock().get() == &segment)
+            {
+                unsaved = compressed;
+            }
+        }
+    }
 }
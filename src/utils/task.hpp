@@ -0,0 +1,400 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/task_future.hpp>
+#include <utils/thread_pool.hpp>
+#include <utils/ui_dispatcher.hpp>
+
+// C++ standard
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template<typename T = void>
+class task;
+
+namespace details
+{
+    class task_promise_base
+    {
+    public:
+        struct final_awaiter
+        {
+            [[nodiscard]] bool await_ready() const noexcept;
+
+            template<typename Promise>
+            [[nodiscard]] std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept;
+
+            void await_resume() const noexcept;
+        };
+
+        [[nodiscard]] std::suspend_always initial_suspend() const noexcept;
+        [[nodiscard]] final_awaiter final_suspend() const noexcept;
+        void unhandled_exception() noexcept;
+
+        void set_continuation(std::coroutine_handle<> continuation) noexcept;
+
+        // called once by the task reaching its end and once by the awaiting coroutine done starting it,
+        // true for the second one, which resumes the awaiting coroutine
+        [[nodiscard]] bool arrive() noexcept;
+
+    protected:
+        std::coroutine_handle<> _continuation = std::noop_coroutine();
+        std::exception_ptr _exception{};
+        std::atomic<bool> _arrived = false;
+
+        void rethrow_if_exception() const;
+    };
+
+    template<typename T>
+    class task_coroutine_promise final : public task_promise_base
+    {
+    public:
+        [[nodiscard]] task<T> get_return_object() noexcept;
+
+        template<typename V>
+        void return_value(V&& value);
+
+        [[nodiscard]] T result();
+
+    private:
+        std::optional<T> _value{};
+    };
+
+    template<>
+    class task_coroutine_promise<void> final : public task_promise_base
+    {
+    public:
+        [[nodiscard]] task<void> get_return_object() noexcept;
+
+        void return_void() const noexcept;
+
+        void result() const;
+    };
+
+    // fire and forget coroutine, frame destroyed when done
+    struct detached_coroutine
+    {
+        struct promise_type
+        {
+            [[nodiscard]] detached_coroutine get_return_object() const noexcept;
+            [[nodiscard]] std::suspend_never initial_suspend() const noexcept;
+            [[nodiscard]] std::suspend_never final_suspend() const noexcept;
+            void return_void() const noexcept;
+            void unhandled_exception() const noexcept;
+        };
+    };
+} // namespace details
+
+// Lazy coroutine: starts when awaited, resumes the awaiting coroutine when done.
+// co_await resume_on(pool) and co_await ui_thread() move the coroutine between threads.
+// A task completing synchronously doesn't resume the awaiting coroutine, which continues without growing the stack.
+template<typename T>
+class [[nodiscard]] task final
+{
+public:
+    using promise_type = details::task_coroutine_promise<T>;
+
+    task() noexcept = default;
+    task(const task&) = delete;
+    task(task&& other) noexcept;
+    task& operator=(const task&) = delete;
+    task& operator=(task&& other) noexcept;
+    ~task() noexcept;
+
+    [[nodiscard]] bool valid() const noexcept;
+
+    [[nodiscard]] auto operator co_await() && noexcept;
+
+private:
+    friend promise_type;
+
+    std::coroutine_handle<promise_type> _handle{};
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept;
+};
+
+// Awaitable resuming the coroutine on a thread_pool worker
+class resume_on final
+{
+public:
+    explicit resume_on(thread_pool& pool, thread_pool::priority lane = thread_pool::priority::normal) noexcept;
+
+    [[nodiscard]] bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> handle) const noexcept;
+    void await_resume() const noexcept;
+
+private:
+    thread_pool& _pool;
+    thread_pool::priority _lane;
+};
+
+// Awaitable resuming the coroutine on the UI thread, when UI_DISPATCHER is drained
+class ui_thread final
+{
+public:
+    [[nodiscard]] bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> handle) const;
+    void await_resume() const noexcept;
+};
+
+// Start a task without awaiting it, the result is available through the returned future
+template<typename T>
+task_future<T> spawn(task<T>&& coroutine);
+
+inline bool details::task_promise_base::final_awaiter::await_ready() const noexcept
+{
+    return false;
+}
+
+template<typename Promise>
+std::coroutine_handle<> details::task_promise_base::final_awaiter::await_suspend(
+  std::coroutine_handle<Promise> handle) noexcept
+{
+    // symmetric transfer to the awaiting coroutine, unless it is still starting the task and continues by itself:
+    // then the frame may be destroyed as soon as arrive() returns
+    task_promise_base& promise = handle.promise();
+    return promise.arrive() ? promise._continuation : std::noop_coroutine();
+}
+
+inline void details::task_promise_base::final_awaiter::await_resume() const noexcept
+{
+}
+
+inline std::suspend_always details::task_promise_base::initial_suspend() const noexcept
+{
+    return {};
+}
+
+inline details::task_promise_base::final_awaiter details::task_promise_base::final_suspend() const noexcept
+{
+    return {};
+}
+
+inline void details::task_promise_base::unhandled_exception() noexcept
+{
+    _exception = std::current_exception();
+}
+
+inline void details::task_promise_base::set_continuation(std::coroutine_handle<> continuation) noexcept
+{
+    _continuation = continuation;
+}
+
+inline bool details::task_promise_base::arrive() noexcept
+{
+    return _arrived.exchange(true, std::memory_order_acq_rel);
+}
+
+inline void details::task_promise_base::rethrow_if_exception() const
+{
+    if(_exception)
+    {
+        std::rethrow_exception(_exception);
+    }
+}
+
+template<typename T>
+task<T> details::task_coroutine_promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<task_coroutine_promise>::from_promise(*this));
+}
+
+template<typename T>
+template<typename V>
+void details::task_coroutine_promise<T>::return_value(V&& value)
+{
+    _value.emplace(std::forward<V>(value));
+}
+
+template<typename T>
+T details::task_coroutine_promise<T>::result()
+{
+    rethrow_if_exception();
+    return std::move(*_value);
+}
+
+inline task<void> details::task_coroutine_promise<void>::get_return_object() noexcept
+{
+    return task<void>(std::coroutine_handle<task_coroutine_promise>::from_promise(*this));
+}
+
+inline void details::task_coroutine_promise<void>::return_void() const noexcept
+{
+}
+
+inline void details::task_coroutine_promise<void>::result() const
+{
+    rethrow_if_exception();
+}
+
+inline details::detached_coroutine details::detached_coroutine::promise_type::get_return_object() const noexcept
+{
+    return {};
+}
+
+inline std::suspend_never details::detached_coroutine::promise_type::initial_suspend() const noexcept
+{
+    return {};
+}
+
+inline std::suspend_never details::detached_coroutine::promise_type::final_suspend() const noexcept
+{
+    return {};
+}
+
+inline void details::detached_coroutine::promise_type::return_void() const noexcept
+{
+}
+
+inline void details::detached_coroutine::promise_type::unhandled_exception() const noexcept
+{
+    std::terminate();
+}
+
+template<typename T>
+task<T>::task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle)
+{
+}
+
+template<typename T>
+task<T>::task(task&& other) noexcept : _handle(std::exchange(other._handle, nullptr))
+{
+}
+
+template<typename T>
+task<T>& task<T>::operator=(task&& other) noexcept
+{
+    if(this != &other)
+    {
+        if(_handle)
+        {
+            _handle.destroy();
+        }
+        _handle = std::exchange(other._handle, nullptr);
+    }
+    return *this;
+}
+
+template<typename T>
+task<T>::~task() noexcept
+{
+    if(_handle)
+    {
+        _handle.destroy();
+    }
+}
+
+template<typename T>
+bool task<T>::valid() const noexcept
+{
+    return static_cast<bool>(_handle);
+}
+
+template<typename T>
+auto task<T>::operator co_await() && noexcept
+{
+    struct awaiter
+    {
+        std::coroutine_handle<promise_type> handle;
+
+        [[nodiscard]] bool await_ready() const noexcept
+        {
+            return !handle || handle.done();
+        }
+
+        [[nodiscard]] bool await_suspend(std::coroutine_handle<> awaiting) const noexcept
+        {
+            promise_type& promise = handle.promise();
+            promise.set_continuation(awaiting);
+            handle.resume();
+            // completed synchronously: don't suspend
+            return !promise.arrive();
+        }
+
+        T await_resume() const
+        {
+            return handle.promise().result();
+        }
+    };
+    return awaiter{_handle};
+}
+
+inline resume_on::resume_on(thread_pool& pool, thread_pool::priority lane) noexcept : _pool(pool), _lane(lane)
+{
+}
+
+inline bool resume_on::await_ready() const noexcept
+{
+    return false;
+}
+
+inline void resume_on::await_suspend(std::coroutine_handle<> handle) const noexcept
+{
+    _pool.exec(_lane, [handle]() { handle.resume(); });
+}
+
+inline void resume_on::await_resume() const noexcept
+{
+}
+
+inline bool ui_thread::await_ready() const noexcept
+{
+    return false;
+}
+
+inline void ui_thread::await_suspend(std::coroutine_handle<> handle) const
+{
+    UI_DISPATCHER.post([handle]() { handle.resume(); });
+}
+
+inline void ui_thread::await_resume() const noexcept
+{
+}
+
+// GCC 12 warns on the frame code it generates for every coroutine, at the closing brace
+#if defined(__GNUC__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wzero-as-null-pointer-constant"
+#endif
+
+template<typename T>
+task_future<T> spawn(task<T>&& coroutine)
+{
+    task_promise<T> promise;
+    task_future<T> future = promise.get_future();
+    [](task<T> awaited, task_promise<T> result) -> details::detached_coroutine
+    {
+        try
+        {
+            if constexpr(std::is_void_v<T>)
+            {
+                co_await std::move(awaited);
+                result.set_value();
+            }
+            else
+            {
+                result.set_value(co_await std::move(awaited));
+            }
+        }
+        catch(...)
+        {
+            result.set_exception(std::current_exception());
+        }
+    }(std::move(coroutine), std::move(promise));
+    return future;
+}
+
+#if defined(__GNUC__)
+#    pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,457 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/block_pool.hpp>
+#include <utils/inplace_task.hpp>
+#include <utils/ui_dispatcher.hpp>
+
+// C++ standard
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+template<typename T>
+class task_promise;
+
+template<typename T>
+class task_future;
+
+namespace details
+{
+    template<typename T>
+    class task_state final
+    {
+    public:
+        using value_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+        [[nodiscard]] static task_state* create();
+
+        void add_ref() noexcept;
+        void release() noexcept;
+
+        template<typename... V>
+        void set_value(V&&... value);
+        void set_exception(std::exception_ptr exception) noexcept;
+
+        // run continuation on the thread setting the result, immediately if already set
+        void set_continuation(inplace_task&& continuation);
+
+        [[nodiscard]] bool ready() const noexcept;
+        void wait() noexcept;
+        template<typename R, typename P>
+        [[nodiscard]] bool wait_for(const std::chrono::duration<R, P>& duration) noexcept;
+
+        // Wait for the result and move it out, rethrow the stored exception if any
+        [[nodiscard]] T take();
+
+    private:
+        std::atomic<unsigned int> _refs = 1;
+        std::atomic<bool> _ready = false;
+        std::mutex _mutex{};
+        std::condition_variable _cv{};
+        std::optional<value_type> _value{};
+        std::exception_ptr _exception{};
+        inplace_task _continuation{};
+
+        task_state() = default;
+        [[nodiscard]] static auto& pool() noexcept;
+        void notify() noexcept;
+    };
+} // namespace details
+
+template<typename T>
+class task_future final
+{
+public:
+    task_future() noexcept = default;
+    task_future(const task_future&) = delete;
+    task_future(task_future&& other) noexcept;
+    task_future& operator=(const task_future&) = delete;
+    task_future& operator=(task_future&& other) noexcept;
+    ~task_future() noexcept;
+
+    [[nodiscard]] bool valid() const noexcept;
+    [[nodiscard]] bool ready() const noexcept;
+
+    // invalidate the future
+    [[nodiscard]] T get();
+
+    void wait() const noexcept;
+
+    template<typename R, typename P>
+    [[nodiscard]] std::future_status wait_for(const std::chrono::duration<R, P>& duration) const noexcept;
+
+    // Run func on the UI thread (UI_DISPATCHER) once the result is set, invalidate the future.
+    // func takes either the ready task_future, or the result in which case exceptions
+    // (task cancellation included) are dropped. Throw std::future_error on an invalid future, as get().
+    template<typename Func>
+    void then_on_ui(Func&& func);
+
+private:
+    friend class task_promise<T>;
+
+    details::task_state<T>* _state = nullptr;
+
+    explicit task_future(details::task_state<T>* state) noexcept;
+};
+
+namespace details
+{
+    template<typename T, typename Func>
+    void invoke_continuation(Func& func, task_future<T>&& future);
+} // namespace details
+
+template<typename T>
+class task_promise final
+{
+public:
+    task_promise();
+    task_promise(const task_promise&) = delete;
+    task_promise(task_promise&& other) noexcept;
+    task_promise& operator=(const task_promise&) = delete;
+    task_promise& operator=(task_promise&& other) noexcept;
+
+    // a promise destroyed without result breaks its future
+    ~task_promise() noexcept;
+
+    [[nodiscard]] task_future<T> get_future() noexcept;
+
+    template<typename... V>
+    void set_value(V&&... value);
+    void set_exception(std::exception_ptr exception) noexcept;
+
+private:
+    details::task_state<T>* _state = nullptr;
+    bool _satisfied = false;
+
+    void abandon() noexcept;
+};
+
+template<typename T>
+auto& details::task_state<T>::pool() noexcept
+{
+    return block_pool<sizeof(task_state), alignof(task_state)>::instance();
+}
+
+template<typename T>
+details::task_state<T>* details::task_state<T>::create()
+{
+    return ::new(pool().acquire()) task_state();
+}
+
+template<typename T>
+void details::task_state<T>::add_ref() noexcept
+{
+    _refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename T>
+void details::task_state<T>::release() noexcept
+{
+    if(_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        this->~task_state();
+        pool().release(this);
+    }
+}
+
+template<typename T>
+template<typename... V>
+void details::task_state<T>::set_value(V&&... value)
+{
+    _value.emplace(std::forward<V>(value)...);
+    notify();
+}
+
+template<typename T>
+void details::task_state<T>::set_exception(std::exception_ptr exception) noexcept
+{
+    _exception = std::move(exception);
+    notify();
+}
+
+template<typename T>
+void details::task_state<T>::set_continuation(inplace_task&& continuation)
+{
+    {
+        const std::scoped_lock lock(_mutex);
+        if(!ready())
+        {
+            _continuation = std::move(continuation);
+            return;
+        }
+    }
+    continuation();
+}
+
+template<typename T>
+bool details::task_state<T>::ready() const noexcept
+{
+    return _ready.load(std::memory_order_acquire);
+}
+
+template<typename T>
+void details::task_state<T>::wait() noexcept
+{
+    if(ready())
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this]() { return ready(); });
+}
+
+template<typename T>
+template<typename R, typename P>
+bool details::task_state<T>::wait_for(const std::chrono::duration<R, P>& duration) noexcept
+{
+    if(ready())
+    {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _cv.wait_for(lock, duration, [this]() { return ready(); });
+}
+
+template<typename T>
+T details::task_state<T>::take()
+{
+    wait();
+    if(_exception)
+    {
+        std::rethrow_exception(_exception);
+    }
+    if constexpr(!std::is_void_v<T>)
+    {
+        return std::move(*_value);
+    }
+}
+
+template<typename T>
+void details::task_state<T>::notify() noexcept
+{
+    inplace_task continuation;
+    {
+        const std::scoped_lock lock(_mutex);
+        _ready.store(true, std::memory_order_release);
+        continuation = std::move(_continuation);
+    }
+    _cv.notify_all();
+    if(continuation)
+    {
+        continuation();
+    }
+}
+
+template<typename T>
+task_future<T>::task_future(details::task_state<T>* state) noexcept : _state(state)
+{
+}
+
+template<typename T>
+task_future<T>::task_future(task_future&& other) noexcept : _state(std::exchange(other._state, nullptr))
+{
+}
+
+template<typename T>
+task_future<T>& task_future<T>::operator=(task_future&& other) noexcept
+{
+    if(this != &other)
+    {
+        if(_state != nullptr)
+        {
+            _state->release();
+        }
+        _state = std::exchange(other._state, nullptr);
+    }
+    return *this;
+}
+
+template<typename T>
+task_future<T>::~task_future() noexcept
+{
+    if(_state != nullptr)
+    {
+        _state->release();
+    }
+}
+
+template<typename T>
+bool task_future<T>::valid() const noexcept
+{
+    return _state != nullptr;
+}
+
+template<typename T>
+bool task_future<T>::ready() const noexcept
+{
+    return _state != nullptr && _state->ready();
+}
+
+template<typename T>
+T task_future<T>::get()
+{
+    if(_state == nullptr)
+    {
+        throw std::future_error(std::future_errc::no_state);
+    }
+    details::task_state<T>* state = std::exchange(_state, nullptr);
+    struct release_guard
+    {
+        details::task_state<T>* state;
+        ~release_guard()
+        {
+            state->release();
+        }
+    } guard{state};
+    return state->take();
+}
+
+template<typename T>
+void task_future<T>::wait() const noexcept
+{
+    if(_state != nullptr)
+    {
+        _state->wait();
+    }
+}
+
+template<typename T>
+template<typename R, typename P>
+std::future_status task_future<T>::wait_for(const std::chrono::duration<R, P>& duration) const noexcept
+{
+    if(_state == nullptr)
+    {
+        return std::future_status::deferred;
+    }
+    return _state->wait_for(duration) ? std::future_status::ready : std::future_status::timeout;
+}
+
+template<typename T>
+template<typename Func>
+void task_future<T>::then_on_ui(Func&& func)
+{
+    if(_state == nullptr)
+    {
+        throw std::future_error(std::future_errc::no_state);
+    }
+    details::task_state<T>* state = std::exchange(_state, nullptr);
+    state->set_continuation(
+      [future = task_future<T>(state), func = std::forward<Func>(func)]() mutable
+      {
+          UI_DISPATCHER.post([future = std::move(future), func = std::move(func)]() mutable
+                             { details::invoke_continuation(func, std::move(future)); });
+      });
+}
+
+template<typename T, typename Func>
+void details::invoke_continuation(Func& func, task_future<T>&& future)
+{
+    if constexpr(std::is_invocable_v<Func&, task_future<T>&&>)
+    {
+        std::invoke(func, std::move(future));
+    }
+    else
+    {
+        try
+        {
+            if constexpr(std::is_void_v<T>)
+            {
+                future.get();
+                std::invoke(func);
+            }
+            else
+            {
+                std::invoke(func, future.get());
+            }
+        }
+        catch(...)
+        {
+        }
+    }
+}
+
+template<typename T>
+task_promise<T>::task_promise() : _state(details::task_state<T>::create())
+{
+}
+
+template<typename T>
+task_promise<T>::task_promise(task_promise&& other) noexcept
+    : _state(std::exchange(other._state, nullptr))
+    , _satisfied(other._satisfied)
+{
+}
+
+template<typename T>
+task_promise<T>& task_promise<T>::operator=(task_promise&& other) noexcept
+{
+    if(this != &other)
+    {
+        abandon();
+        _state = std::exchange(other._state, nullptr);
+        _satisfied = other._satisfied;
+    }
+    return *this;
+}
+
+template<typename T>
+task_promise<T>::~task_promise() noexcept
+{
+    abandon();
+}
+
+template<typename T>
+task_future<T> task_promise<T>::get_future() noexcept
+{
+    _state->add_ref();
+    return task_future<T>(_state);
+}
+
+template<typename T>
+template<typename... V>
+void task_promise<T>::set_value(V&&... value)
+{
+    _state->set_value(std::forward<V>(value)...);
+    _satisfied = true;
+}
+
+template<typename T>
+void task_promise<T>::set_exception(std::exception_ptr exception) noexcept
+{
+    _state->set_exception(std::move(exception));
+    _satisfied = true;
+}
+
+template<typename T>
+void task_promise<T>::abandon() noexcept
+{
+    if(_state == nullptr)
+    {
+        return;
+    }
+    if(!_satisfied)
+    {
+        _state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+    _state->release();
+    _state = nullptr;
+}
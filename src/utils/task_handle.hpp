@@ -0,0 +1,155 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/task_future.hpp>
+
+// C++ standard
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <stop_token>
+#include <utility>
+
+// Result of a task cancelled before it started
+class task_cancelled final : public std::runtime_error
+{
+public:
+    task_cancelled() : std::runtime_error("task cancelled")
+    {
+    }
+};
+
+// Future of a cancellable task, requests stop when destroyed or overwritten (like std::jthread)
+template<typename T>
+class task_handle final
+{
+public:
+    task_handle() noexcept = default;
+    task_handle(task_future<T>&& future, std::stop_source&& stop_source) noexcept;
+    task_handle(const task_handle&) = delete;
+    task_handle(task_handle&& other) noexcept = default;
+    task_handle& operator=(const task_handle&) = delete;
+    task_handle& operator=(task_handle&& other) noexcept;
+    ~task_handle() noexcept;
+
+    [[nodiscard]] bool valid() const noexcept;
+    [[nodiscard]] bool ready() const noexcept;
+
+    // a task not started yet is skipped, a running one has to check its std::stop_token
+    bool request_stop() noexcept;
+    [[nodiscard]] bool stop_requested() const noexcept;
+    [[nodiscard]] std::stop_token get_token() const noexcept;
+
+    // invalidate the handle, throw task_cancelled if the task was skipped
+    [[nodiscard]] T get();
+
+    void wait() const noexcept;
+
+    template<typename R, typename P>
+    [[nodiscard]] std::future_status wait_for(const std::chrono::duration<R, P>& duration) const noexcept;
+
+    // see task_future::then_on_ui, the handle keeps the ability to cancel the task
+    // and nothing is delivered once stop is requested
+    template<typename Func>
+    void then_on_ui(Func&& func);
+
+private:
+    task_future<T> _future{};
+    std::stop_source _stop_source{std::nostopstate};
+};
+
+template<typename T>
+task_handle<T>::task_handle(task_future<T>&& future, std::stop_source&& stop_source) noexcept
+    : _future(std::move(future))
+    , _stop_source(std::move(stop_source))
+{
+}
+
+template<typename T>
+task_handle<T>& task_handle<T>::operator=(task_handle&& other) noexcept
+{
+    if(this != &other)
+    {
+        request_stop();
+        _future = std::move(other._future);
+        _stop_source = std::exchange(other._stop_source, std::stop_source(std::nostopstate));
+    }
+    return *this;
+}
+
+template<typename T>
+task_handle<T>::~task_handle() noexcept
+{
+    request_stop();
+}
+
+template<typename T>
+bool task_handle<T>::valid() const noexcept
+{
+    return _future.valid();
+}
+
+template<typename T>
+bool task_handle<T>::ready() const noexcept
+{
+    return _future.ready();
+}
+
+template<typename T>
+bool task_handle<T>::request_stop() noexcept
+{
+    return _stop_source.request_stop();
+}
+
+template<typename T>
+bool task_handle<T>::stop_requested() const noexcept
+{
+    return _stop_source.stop_requested();
+}
+
+template<typename T>
+std::stop_token task_handle<T>::get_token() const noexcept
+{
+    return _stop_source.get_token();
+}
+
+template<typename T>
+T task_handle<T>::get()
+{
+    _stop_source = std::stop_source(std::nostopstate);
+    return _future.get();
+}
+
+template<typename T>
+void task_handle<T>::wait() const noexcept
+{
+    _future.wait();
+}
+
+template<typename T>
+template<typename R, typename P>
+std::future_status task_handle<T>::wait_for(const std::chrono::duration<R, P>& duration) const noexcept
+{
+    return _future.wait_for(duration);
+}
+
+template<typename T>
+template<typename Func>
+void task_handle<T>::then_on_ui(Func&& func)
+{
+    _future.then_on_ui(
+      [stop_token = _stop_source.get_token(), func = std::forward<Func>(func)](task_future<T>&& future) mutable
+      {
+          if(!stop_token.stop_requested())
+          {
+              details::invoke_continuation(func, std::move(future));
+          }
+      });
+}
@@ -7,39 +7,112 @@
 //
 #pragma once
 
+// project
+#include <utils/inplace_task.hpp>
+#include <utils/task_future.hpp>
+#include <utils/task_handle.hpp>
+#include <utils/thread_priority.hpp>
+
 // C++ standard
 #include <algorithm>
 #include <atomic>
+#include <concepts>
 #include <condition_variable>
 #include <functional>
-#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <stop_token>
 #include <thread>
+#include <vector>
+
+namespace details
+{
+    // result of a cancellable task, which may take a std::stop_token as first argument
+    template<typename Func, typename... Args>
+    struct cancellable_result : std::invoke_result<Func, Args...>
+    {
+    };
+
+    template<typename Func, typename... Args>
+        requires std::invocable<Func, std::stop_token, Args...>
+    struct cancellable_result<Func, Args...> : std::invoke_result<Func, std::stop_token, Args...>
+    {
+    };
+} // namespace details
 
 class thread_pool
 {
 public:
+    enum class scheduling
+    {
+        // one queue shared by all workers
+        single_queue,
+        // one deque per worker, tasks submitted from a worker stay local, idle workers steal
+        work_stealing
+    };
+
+    enum class priority
+    {
+        // dequeued before anything else
+        interactive,
+        normal,
+        // run by the background workers, at a lower OS scheduling priority
+        background
+    };
+
+    static constexpr size_t PRIORITY_COUNT = 3;
+
     thread_pool(const thread_pool&) noexcept = delete;
     thread_pool(thread_pool&&) noexcept = delete;
     thread_pool& operator=(const thread_pool&) noexcept = delete;
     thread_pool& operator=(thread_pool&&) noexcept = delete;
 
-    explicit thread_pool(size_t thread_number = std::thread::hardware_concurrency()) noexcept;
+    // with no background thread, background tasks are run by the workers after the other priorities
+    explicit thread_pool(size_t thread_number = std::thread::hardware_concurrency(),
+                         scheduling mode = scheduling::single_queue,
+                         size_t background_thread_number = 1) noexcept;
     ~thread_pool() noexcept;
 
     [[nodiscard]] size_t tasks_queued() const noexcept;
+    [[nodiscard]] size_t tasks_queued(priority lane) const noexcept;
     [[nodiscard]] size_t tasks_running() const noexcept;
     [[nodiscard]] size_t tasks_total() const noexcept;
     [[nodiscard]] size_t thread_number() const noexcept;
+    [[nodiscard]] size_t background_thread_number() const noexcept;
+    [[nodiscard]] scheduling mode() const noexcept;
 
+    // exec and submit don't allocate for tasks stored inline by inplace_task, once the queues reached their backlog:
+    // a queue grows past it by doubling, and if that fails the task runs on the calling thread
     template<typename Func, typename... Args>
+        requires std::invocable<std::decay_t<Func>, std::decay_t<Args>...>
     void exec(Func&& task, Args&&... args) noexcept;
 
+    template<typename Func, typename... Args>
+        requires std::invocable<std::decay_t<Func>, std::decay_t<Args>...>
+    void exec(priority lane, Func&& task, Args&&... args) noexcept;
+
+    template<typename Func,
+             typename... Args,
+             typename Res = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>>
+    [[nodiscard]] task_future<Res> submit(Func&& task, Args&&... args) noexcept;
+
     template<typename Func,
              typename... Args,
              typename Res = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>>
-    [[nodiscard]] std::future<Res> submit(Func&& task, Args&&... args) noexcept;
+    [[nodiscard]] task_future<Res> submit(priority lane, Func&& task, Args&&... args) noexcept;
+
+    // task may take a std::stop_token as first argument to stop early,
+    // a task whose stop is requested before it starts is dropped without running
+    template<typename Func,
+             typename... Args,
+             typename Res = typename details::cancellable_result<std::decay_t<Func>, std::decay_t<Args>...>::type>
+    [[nodiscard]] task_handle<Res> submit_cancellable(Func&& task, Args&&... args) noexcept;
+
+    template<typename Func,
+             typename... Args,
+             typename Res = typename details::cancellable_result<std::decay_t<Func>, std::decay_t<Args>...>::type>
+    [[nodiscard]] task_handle<Res> submit_cancellable(priority lane, Func&& task, Args&&... args) noexcept;
 
     void wait() noexcept;
 
@@ -47,62 +120,148 @@ public:
     bool wait_for(const std::chrono::duration<R, P>& duration) noexcept;
 
 private:
+    // growable ring buffer, only allocates to grow past its largest backlog so far
+    class task_deque
+    {
+    public:
+        task_deque();
+
+        [[nodiscard]] bool empty() const noexcept;
+        // false, with task left untouched, if growing the buffer failed
+        [[nodiscard]] bool try_push_back(inplace_task&& task) noexcept;
+        [[nodiscard]] inplace_task pop_back() noexcept;
+        [[nodiscard]] inplace_task pop_front() noexcept;
+
+    private:
+        static constexpr size_t INITIAL_CAPACITY = 64;
+
+        std::vector<inplace_task> _buffer;
+        size_t _head = 0;
+        size_t _size = 0;
+    };
+
+    struct alignas(64) task_queue
+    {
+        std::mutex mutex{};
+        task_deque lanes[PRIORITY_COUNT]{};
+    };
+
+    struct worker_context
+    {
+        const thread_pool* pool;
+        size_t index;
+    };
+
+    static inline thread_local worker_context _current_worker{};
+
+    const scheduling _mode;
+
     std::atomic<bool> _running = false;
 
+    // one queue in single_queue mode, one per worker in work_stealing mode
+    std::vector<std::unique_ptr<task_queue>> _queues{};
+    std::atomic<size_t> _next_queue = 0;
+
+    // background tasks when there are background workers
+    task_queue _background_queue{};
+
+    // queued + running
+    std::atomic<size_t> _tasks_count = 0;
+    std::atomic<size_t> _lanes_queued[PRIORITY_COUNT]{};
+    // bumped by each task queued for the workers, a worker whose scan failed sleeps until it changes
+    std::atomic<size_t> _pushes = 0;
+
     std::condition_variable _task_available{};
-    std::condition_variable _task_done{};
+    std::condition_variable _background_task_available{};
+    std::atomic<size_t> _sleeping_workers = 0;
+    std::atomic<size_t> _sleeping_background_workers = 0;
+    std::mutex _sleep_mutex{};
 
-    std::queue<std::function<void()>> _tasks{};
-    size_t _tasks_count = 0;
-    mutable std::mutex _tasks_mutex{};
+    std::condition_variable _task_done{};
+    std::mutex _done_mutex{};
 
     std::vector<std::thread> _threads{};
+    std::vector<std::thread> _background_threads{};
+
+    [[nodiscard]] static constexpr size_t lane_index(priority lane) noexcept;
+    [[nodiscard]] size_t worker_tasks_queued() const noexcept;
 
-    void worker() noexcept;
+    void push(priority lane, inplace_task&& task) noexcept;
+    void run_unqueued(inplace_task&& task) noexcept;
+    [[nodiscard]] bool pop(size_t worker_index, inplace_task& task) noexcept;
+    void task_done() noexcept;
+    void worker(size_t index) noexcept;
+    void background_worker() noexcept;
 };
 
-inline thread_pool::thread_pool(size_t thread_number) noexcept
+inline thread_pool::thread_pool(size_t thread_number, scheduling mode, size_t background_thread_number) noexcept
+    : _mode(mode)
 {
     _running = true;
     _threads.resize(std::max(static_cast<size_t>(1ul), thread_number));
-    for(std::thread& thread: _threads)
+    _background_threads.resize(background_thread_number);
+    _queues.resize(_mode == scheduling::work_stealing ? _threads.size() : 1);
+    for(std::unique_ptr<task_queue>& queue: _queues)
     {
-        thread = std::thread(&thread_pool::worker, this);
+        queue = std::make_unique<task_queue>();
+    }
+    for(size_t i = 0; i < _threads.size(); ++i)
+    {
+        _threads[i] = std::thread(&thread_pool::worker, this, i);
+    }
+    for(std::thread& thread: _background_threads)
+    {
+        thread = std::thread(&thread_pool::background_worker, this);
     }
 }
 
 inline thread_pool::~thread_pool() noexcept
 {
     // end all tasks
-    {
-        std::unique_lock<std::mutex> tasks_lock(_tasks_mutex);
-        _task_done.wait(tasks_lock, [this]() { return (_tasks_count == 0); });
-    }
+    wait();
 
     // end threads
-    _running = false;
+    {
+        const std::scoped_lock sleep_lock(_sleep_mutex);
+        _running = false;
+    }
     _task_available.notify_all();
+    _background_task_available.notify_all();
     for(std::thread& thread: _threads)
     {
         thread.join();
     }
+    for(std::thread& thread: _background_threads)
+    {
+        thread.join();
+    }
 }
 
 inline size_t thread_pool::tasks_queued() const noexcept
 {
-    const std::scoped_lock tasks_lock(_tasks_mutex);
-    return _tasks.size();
+    size_t queued = 0;
+    for(const std::atomic<size_t>& lane_queued: _lanes_queued)
+    {
+        queued += lane_queued.load();
+    }
+    return queued;
+}
+
+inline size_t thread_pool::tasks_queued(priority lane) const noexcept
+{
+    return _lanes_queued[lane_index(lane)].load();
 }
 
 inline size_t thread_pool::tasks_running() const noexcept
 {
-    const std::scoped_lock tasks_lock(_tasks_mutex);
-    return _tasks_count - _tasks.size();
+    const size_t queued = tasks_queued();
+    const size_t total = _tasks_count.load();
+    return total > queued ? total - queued : 0;
 }
 
 inline size_t thread_pool::tasks_total() const noexcept
 {
-    return _tasks_count;
+    return _tasks_count.load();
 }
 
 inline size_t thread_pool::thread_number() const noexcept
@@ -110,83 +269,430 @@ inline size_t thread_pool::thread_number() const noexcept
     return _threads.size();
 }
 
+inline size_t thread_pool::background_thread_number() const noexcept
+{
+    return _background_threads.size();
+}
+
+inline thread_pool::scheduling thread_pool::mode() const noexcept
+{
+    return _mode;
+}
+
+template<typename Func, typename... Args, typename Res>
+task_future<Res> thread_pool::submit(Func&& task, Args&&... args) noexcept
+{
+    return submit(priority::normal, std::forward<Func>(task), std::forward<Args>(args)...);
+}
+
 template<typename Func, typename... Args, typename Res>
-std::future<Res> thread_pool::submit(Func&& task, Args&&... args) noexcept
+task_future<Res> thread_pool::submit(priority lane, Func&& task, Args&&... args) noexcept
 {
-    std::function<Res()> task_function = std::bind(std::forward<Func>(task), std::forward<Args>(args)...);
-    std::shared_ptr<std::promise<Res>> promise = std::make_shared<std::promise<Res>>();
-    std::future<Res> future = promise->get_future();
-    exec(
-      [task_function = std::move(task_function), promise = std::move(promise)]() noexcept
+    task_promise<Res> promise;
+    task_future<Res> future = promise.get_future();
+    push(
+      lane,
+      [task = std::forward<Func>(task), ... args = std::forward<Args>(args), promise = std::move(promise)]() mutable noexcept
       {
           try
           {
               if constexpr(std::is_void_v<Res>)
               {
-                  std::invoke(task_function);
-                  promise->set_value();
+                  std::invoke(std::move(task), std::move(args)...);
+                  promise.set_value();
               }
               else
               {
-                  auto tmp = std::invoke(task_function);
-                  promise->set_value(tmp);
+                  promise.set_value(std::invoke(std::move(task), std::move(args)...));
               }
           }
           catch(...)
           {
-              try
-              {
-                  promise->set_exception(std::current_exception());
-              }
-              catch(...)
-              {
-              }
+              promise.set_exception(std::current_exception());
           }
       });
     return future;
 }
 
+template<typename Func, typename... Args, typename Res>
+task_handle<Res> thread_pool::submit_cancellable(Func&& task, Args&&... args) noexcept
+{
+    return submit_cancellable(priority::normal, std::forward<Func>(task), std::forward<Args>(args)...);
+}
+
+template<typename Func, typename... Args, typename Res>
+task_handle<Res> thread_pool::submit_cancellable(priority lane, Func&& task, Args&&... args) noexcept
+{
+    std::stop_source stop_source;
+    task_promise<Res> promise;
+    task_future<Res> future = promise.get_future();
+    push(lane,
+         [task = std::forward<Func>(task),
+          ... args = std::forward<Args>(args),
+          promise = std::move(promise),
+          token = stop_source.get_token()]() mutable noexcept
+         {
+             try
+             {
+                 if(token.stop_requested())
+                 {
+                     throw task_cancelled();
+                 }
+                 auto invoke = [&]() -> Res
+                 {
+                     if constexpr(std::is_invocable_v<std::decay_t<Func>, std::stop_token, std::decay_t<Args>...>)
+                     {
+                         return std::invoke(std::move(task), std::move(token), std::move(args)...);
+                     }
+                     else
+                     {
+                         return std::invoke(std::move(task), std::move(args)...);
+                     }
+                 };
+                 if constexpr(std::is_void_v<Res>)
+                 {
+                     invoke();
+                     promise.set_value();
+                 }
+                 else
+                 {
+                     promise.set_value(invoke());
+                 }
+             }
+             catch(...)
+             {
+                 promise.set_exception(std::current_exception());
+             }
+         });
+    return task_handle<Res>(std::move(future), std::move(stop_source));
+}
+
 template<typename Func, typename... Args>
+    requires std::invocable<std::decay_t<Func>, std::decay_t<Args>...>
 void thread_pool::exec(Func&& task, Args&&... args) noexcept
 {
-    std::function<void()> task_function = std::bind(std::forward<Func>(task), std::forward<Args>(args)...);
+    exec(priority::normal, std::forward<Func>(task), std::forward<Args>(args)...);
+}
+
+template<typename Func, typename... Args>
+    requires std::invocable<std::decay_t<Func>, std::decay_t<Args>...>
+void thread_pool::exec(priority lane, Func&& task, Args&&... args) noexcept
+{
+    if constexpr(sizeof...(Args) == 0)
+    {
+        push(lane, std::forward<Func>(task));
+    }
+    else
     {
-        const std::scoped_lock tasks_lock(_tasks_mutex);
-        _tasks.push(std::move(task_function));
-        ++_tasks_count;
+        push(lane,
+             [task = std::forward<Func>(task), ... args = std::forward<Args>(args)]() mutable noexcept(
+               std::is_nothrow_invocable_v<std::decay_t<Func>, std::decay_t<Args>...>)
+             { std::invoke(std::move(task), std::move(args)...); });
     }
-    _task_available.notify_one();
 }
 
 inline void thread_pool::wait() noexcept
 {
-    std::unique_lock<std::mutex> tasks_lock(_tasks_mutex);
-    _task_done.wait(tasks_lock, [this]() { return (_tasks_count == 0); });
+    std::unique_lock<std::mutex> done_lock(_done_mutex);
+    _task_done.wait(done_lock, [this]() { return (_tasks_count == 0); });
 }
 
 template<typename R, typename P>
 bool thread_pool::wait_for(const std::chrono::duration<R, P>& duration) noexcept
 {
-    std::unique_lock<std::mutex> tasks_lock(_tasks_mutex);
-    return _task_done.wait_for(tasks_lock, duration, [this]() { return (_tasks_count == 0); });
+    std::unique_lock<std::mutex> done_lock(_done_mutex);
+    return _task_done.wait_for(done_lock, duration, [this]() { return (_tasks_count == 0); });
+}
+
+constexpr size_t thread_pool::lane_index(priority lane) noexcept
+{
+    return static_cast<size_t>(lane);
+}
+
+inline size_t thread_pool::worker_tasks_queued() const noexcept
+{
+    size_t queued = _lanes_queued[lane_index(priority::interactive)] + _lanes_queued[lane_index(priority::normal)];
+    if(_background_threads.empty())
+    {
+        queued += _lanes_queued[lane_index(priority::background)];
+    }
+    return queued;
 }
 
-inline void thread_pool::worker() noexcept
+inline void thread_pool::push(priority lane, inplace_task&& task) noexcept
 {
-    while(_running)
+    const size_t index = lane_index(lane);
+    ++_tasks_count;
+
+    if(lane == priority::background && !_background_threads.empty())
     {
-        std::function<void()> task;
-        std::unique_lock<std::mutex> tasks_lock(_tasks_mutex);
-        _task_available.wait(tasks_lock, [this]() { return !_tasks.empty() || !_running; });
-        if(_running)
+        bool queued = false;
+        {
+            // counted under the queue lock: the worker popping the task decrements under it
+            const std::scoped_lock queue_lock(_background_queue.mutex);
+            queued = _background_queue.lanes[index].try_push_back(std::move(task));
+            if(queued)
+            {
+                ++_lanes_queued[index];
+            }
+        }
+        if(!queued)
+        {
+            run_unqueued(std::move(task));
+            return;
+        }
+        if(_sleeping_background_workers > 0)
+        {
+            {
+                const std::scoped_lock sleep_lock(_sleep_mutex);
+            }
+            _background_task_available.notify_one();
+        }
+        return;
+    }
+
+    // tasks submitted from one of our workers stay local, others are spread round-robin
+    size_t queue_index = 0;
+    if(_mode == scheduling::work_stealing)
+    {
+        if(_current_worker.pool == this && _current_worker.index < _queues.size())
+        {
+            queue_index = _current_worker.index;
+        }
+        else
+        {
+            queue_index = _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+        }
+    }
+
+    bool queued = false;
+    {
+        task_queue& queue = *_queues[queue_index];
+        const std::scoped_lock queue_lock(queue.mutex);
+        queued = queue.lanes[index].try_push_back(std::move(task));
+        if(queued)
+        {
+            ++_lanes_queued[index];
+        }
+    }
+    if(!queued)
+    {
+        run_unqueued(std::move(task));
+        return;
+    }
+    ++_pushes;
+
+    // only pay for the sleep mutex when a worker may be waiting
+    if(_sleeping_workers > 0)
+    {
+        {
+            const std::scoped_lock sleep_lock(_sleep_mutex);
+        }
+        _task_available.notify_one();
+    }
+}
+
+inline void thread_pool::run_unqueued(inplace_task&& task) noexcept
+{
+    // out of memory to grow the queue: the caller runs the task rather than losing it
+    inplace_task unqueued = std::move(task);
+    unqueued();
+    unqueued = nullptr;
+    task_done();
+}
+
+inline bool thread_pool::pop(size_t worker_index, inplace_task& task) noexcept
+{
+    const size_t lanes = _background_threads.empty() ? PRIORITY_COUNT : lane_index(priority::background);
+    for(size_t lane = 0; lane < lanes; ++lane)
+    {
+        if(_lanes_queued[lane] == 0)
+        {
+            continue;
+        }
+
+        if(_mode == scheduling::single_queue)
+        {
+            task_queue& queue = *_queues.front();
+            const std::scoped_lock queue_lock(queue.mutex);
+            if(!queue.lanes[lane].empty())
+            {
+                task = queue.lanes[lane].pop_front();
+                --_lanes_queued[lane];
+                return true;
+            }
+            continue;
+        }
+
+        // own deque first (LIFO, cache friendly)
+        {
+            task_queue& queue = *_queues[worker_index];
+            const std::scoped_lock queue_lock(queue.mutex);
+            if(!queue.lanes[lane].empty())
+            {
+                task = queue.lanes[lane].pop_back();
+                --_lanes_queued[lane];
+                return true;
+            }
+        }
+
+        // steal oldest task of the other workers, skipping the busy ones
+        bool busy_victim = false;
+        for(size_t i = 1; i < _queues.size(); ++i)
+        {
+            task_queue& queue = *_queues[(worker_index + i) % _queues.size()];
+            std::unique_lock<std::mutex> queue_lock(queue.mutex, std::try_to_lock);
+            if(!queue_lock.owns_lock())
+            {
+                busy_victim = true;
+                continue;
+            }
+            if(!queue.lanes[lane].empty())
+            {
+                task = queue.lanes[lane].pop_front();
+                --_lanes_queued[lane];
+                return true;
+            }
+        }
+
+        // then waiting for their lock: a failed scan must mean the lane was empty
+        for(size_t i = 1; busy_victim && i < _queues.size(); ++i)
+        {
+            task_queue& queue = *_queues[(worker_index + i) % _queues.size()];
+            const std::scoped_lock queue_lock(queue.mutex);
+            if(!queue.lanes[lane].empty())
+            {
+                task = queue.lanes[lane].pop_front();
+                --_lanes_queued[lane];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+inline void thread_pool::task_done() noexcept
+{
+    if(--_tasks_count == 0)
+    {
+        {
+            const std::scoped_lock done_lock(_done_mutex);
+        }
+        _task_done.notify_all();
+    }
+}
+
+inline thread_pool::task_deque::task_deque() : _buffer(INITIAL_CAPACITY)
+{
+}
+
+inline bool thread_pool::task_deque::empty() const noexcept
+{
+    return _size == 0;
+}
+
+inline bool thread_pool::task_deque::try_push_back(inplace_task&& task) noexcept
+{
+    if(_size == _buffer.size())
+    {
+        std::vector<inplace_task> buffer;
+        try
+        {
+            buffer.resize(_buffer.size() * 2);
+        }
+        catch(const std::bad_alloc&)
+        {
+            return false;
+        }
+        for(size_t i = 0; i < _size; ++i)
+        {
+            buffer[i] = std::move(_buffer[(_head + i) % _buffer.size()]);
+        }
+        _buffer = std::move(buffer);
+        _head = 0;
+    }
+    _buffer[(_head + _size) % _buffer.size()] = std::move(task);
+    ++_size;
+    return true;
+}
+
+inline inplace_task thread_pool::task_deque::pop_back() noexcept
+{
+    --_size;
+    return std::move(_buffer[(_head + _size) % _buffer.size()]);
+}
+
+inline inplace_task thread_pool::task_deque::pop_front() noexcept
+{
+    inplace_task task = std::move(_buffer[_head]);
+    _head = (_head + 1) % _buffer.size();
+    --_size;
+    return task;
+}
+
+inline void thread_pool::worker(size_t index) noexcept
+{
+    _current_worker = worker_context{this, index};
+    inplace_task task;
+    while(true)
+    {
+        const size_t pushes = _pushes;
+        if(pop(index, task))
+        {
+            task();
+            task = nullptr;
+            task_done();
+            continue;
+        }
+
+        // the tasks still counted were taken by other workers during the scan: sleep until the next push, don't spin
+        std::unique_lock<std::mutex> sleep_lock(_sleep_mutex);
+        ++_sleeping_workers;
+        _task_available.wait(sleep_lock, [this, pushes]() { return _pushes != pushes || !_running; });
+        --_sleeping_workers;
+        if(!_running && worker_tasks_queued() == 0)
+        {
+            break;
+        }
+    }
+    _current_worker = worker_context{nullptr, 0};
+}
+
+inline void thread_pool::background_worker() noexcept
+{
+    // index out of the worker queues range: tasks submitted from here are spread round-robin
+    _current_worker = worker_context{this, _queues.size()};
+    [[maybe_unused]] const bool lowered = lower_current_thread_priority();
+
+    static constexpr size_t index = lane_index(priority::background);
+    std::atomic<size_t>& queued = _lanes_queued[index];
+    inplace_task task;
+    while(true)
+    {
+        {
+            const std::scoped_lock queue_lock(_background_queue.mutex);
+            if(!_background_queue.lanes[index].empty())
+            {
+                task = _background_queue.lanes[index].pop_front();
+                --queued;
+            }
+        }
+        if(task)
         {
-            task = std::move(_tasks.front());
-            _tasks.pop();
-            tasks_lock.unlock();
             task();
-            tasks_lock.lock();
-            --_tasks_count;
-            _task_done.notify_all();
+            task = nullptr;
+            task_done();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> sleep_lock(_sleep_mutex);
+        ++_sleeping_background_workers;
+        _background_task_available.wait(sleep_lock, [&]() { return queued > 0 || !_running; });
+        --_sleeping_background_workers;
+        if(!_running && queued == 0)
+        {
+            break;
         }
     }
+    _current_worker = worker_context{nullptr, 0};
 }
@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "thread_priority.hpp"
+
+#if defined(_WIN32)
+#    include <windows.h>
+#elif defined(__APPLE__)
+#    include <pthread.h>
+#    include <pthread/qos.h>
+#elif defined(__linux__)
+#    include <sys/resource.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+bool lower_current_thread_priority() noexcept
+{
+#if defined(_WIN32)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL) != 0;
+#elif defined(__APPLE__)
+    return pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0) == 0;
+#elif defined(__linux__)
+    // nice value is per thread on Linux
+    static constexpr int background_nice = 10;
+    const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    return setpriority(PRIO_PROCESS, tid, background_nice) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,12 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// Lower the OS scheduling priority of the calling thread.
+// return false if not supported or on error
+[[nodiscard]] bool lower_current_thread_priority() noexcept;
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "ui_dispatcher.hpp"
+
+// C++ standard
+#include <utility>
+
+// nodes of the calling thread, linked through their next pointer
+struct ui_dispatcher::node_cache
+{
+    static constexpr size_t NODES_PER_CHUNK = 64;
+
+    node* first = nullptr;
+
+    node_cache() noexcept = default;
+    node_cache(const node_cache&) = delete;
+    node_cache(node_cache&&) = delete;
+    node_cache& operator=(const node_cache&) = delete;
+    node_cache& operator=(node_cache&&) = delete;
+
+    // the nodes of an exiting thread go back to the free list
+    ~node_cache() noexcept
+    {
+        if(first == nullptr)
+        {
+            return;
+        }
+        node* last = first;
+        while(node* next = last->next.load(std::memory_order_relaxed))
+        {
+            last = next;
+        }
+        release(first, last);
+    }
+};
+
+std::atomic<ui_dispatcher::node*> ui_dispatcher::_free_nodes = nullptr;
+thread_local ui_dispatcher::node_cache ui_dispatcher::_node_cache;
+
+ui_dispatcher UI_DISPATCHER;
+
+ui_dispatcher::ui_dispatcher() noexcept : _head(&_stub), _tail(&_stub)
+{
+}
+
+ui_dispatcher::~ui_dispatcher() noexcept
+{
+    // drop tasks never run
+    while(node* n = pop())
+    {
+        release(n);
+    }
+}
+
+void ui_dispatcher::post(inplace_task&& task)
+{
+    node* n = acquire();
+    n->task = std::move(task);
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    push(n);
+}
+
+size_t ui_dispatcher::drain(std::chrono::steady_clock::duration budget)
+{
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + budget;
+    size_t count = 0;
+    while(node* n = pop())
+    {
+        inplace_task task = std::move(n->task);
+        release(n);
+        _pending.fetch_sub(1, std::memory_order_relaxed);
+        task();
+        ++count;
+        if(std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+size_t ui_dispatcher::pending() const noexcept
+{
+    return _pending.load(std::memory_order_relaxed);
+}
+
+void ui_dispatcher::push(node* n) noexcept
+{
+    n->next.store(nullptr, std::memory_order_relaxed);
+    node* previous = _head.exchange(n, std::memory_order_acq_rel);
+    previous->next.store(n, std::memory_order_release);
+}
+
+ui_dispatcher::node* ui_dispatcher::pop() noexcept
+{
+    node* tail = _tail;
+    node* next = tail->next.load(std::memory_order_acquire);
+    if(tail == &_stub)
+    {
+        if(next == nullptr)
+        {
+            return nullptr;
+        }
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if(next != nullptr)
+    {
+        _tail = next;
+        return tail;
+    }
+    if(tail != _head.load(std::memory_order_acquire))
+    {
+        // a producer is between the exchange and the link, retry next drain
+        return nullptr;
+    }
+    push(&_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if(next != nullptr)
+    {
+        _tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+ui_dispatcher::node* ui_dispatcher::acquire()
+{
+    node_cache& cache = _node_cache;
+    if(cache.first == nullptr)
+    {
+        cache.first = _free_nodes.exchange(nullptr, std::memory_order_acquire);
+    }
+    if(cache.first == nullptr)
+    {
+        // leaked on purpose: nodes may be in flight until the end of the program
+        node* chunk = new node[node_cache::NODES_PER_CHUNK];
+        for(size_t i = 0; i + 1 < node_cache::NODES_PER_CHUNK; ++i)
+        {
+            chunk[i].next.store(&chunk[i + 1], std::memory_order_relaxed);
+        }
+        cache.first = chunk;
+    }
+    node* n = cache.first;
+    cache.first = n->next.load(std::memory_order_relaxed);
+    return n;
+}
+
+void ui_dispatcher::release(node* n) noexcept
+{
+    n->task = nullptr;
+    release(n, n);
+}
+
+void ui_dispatcher::release(node* first, node* last) noexcept
+{
+    node* head = _free_nodes.load(std::memory_order_relaxed);
+    do
+    {
+        last->next.store(head, std::memory_order_relaxed);
+    } while(!_free_nodes.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+}
@@ -0,0 +1,66 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// project
+#include <utils/inplace_task.hpp>
+
+// C++ standard
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Tasks posted from any thread, run by the UI thread when it drains the queue.
+// Intrusive lock-free MPSC queue (Vyukov), nodes are recycled through a lock-free free list:
+// posting only takes a lock when every node is in use and a new chunk of nodes has to be allocated.
+class ui_dispatcher final
+{
+public:
+    ui_dispatcher() noexcept;
+    ui_dispatcher(const ui_dispatcher&) = delete;
+    ui_dispatcher(ui_dispatcher&&) = delete;
+    ui_dispatcher& operator=(const ui_dispatcher&) = delete;
+    ui_dispatcher& operator=(ui_dispatcher&&) = delete;
+    ~ui_dispatcher() noexcept;
+
+    // thread safe
+    void post(inplace_task&& task);
+
+    // UI thread only: run posted tasks until the queue is empty or the budget is spent,
+    // at least one task is run if any. return the number of tasks run
+    size_t drain(std::chrono::steady_clock::duration budget);
+
+    [[nodiscard]] size_t pending() const noexcept;
+
+private:
+    struct node
+    {
+        std::atomic<node*> next = nullptr;
+        inplace_task task{};
+    };
+
+    struct node_cache;
+
+    // free nodes, pushed back by the draining thread and taken whole by the posting threads into their cache:
+    // the shared list is only pushed to and exchanged, which can't suffer from ABA
+    static std::atomic<node*> _free_nodes;
+    static thread_local node_cache _node_cache;
+
+    std::atomic<node*> _head;
+    node* _tail;
+    node _stub{};
+    std::atomic<size_t> _pending = 0;
+
+    void push(node* n) noexcept;
+    [[nodiscard]] node* pop() noexcept;
+    [[nodiscard]] static node* acquire();
+    static void release(node* n) noexcept;
+    static void release(node* first, node* last) noexcept;
+};
+
+extern ui_dispatcher UI_DISPATCHER;
@@ -1419,7 +1419,7 @@ namespace
     };
 } // namespace
 
-IconsFinder::IconsFinder() noexcept : _logger(logging::get_logger("IconsFinder"))
+IconsFinder::IconsFinder() noexcept : _logger(logging::static_logger<"IconsFinder">())
 {
 }
 
@@ -10,15 +10,26 @@
 #include "LogViewer.hpp"
 
 // project
+#include <utils/binary_log.hpp>
 #include <utils/log.hpp>
+#include <utils/ui_dispatcher.hpp>
+#include <view/font.hpp>
 #include <view/style/colors.hpp>
 
 // external
+#include <fmt/chrono.h>
+#include <fmt/format.h>
 #include <imgui_internal.h>
+#include <implot.h>
+#include <spdlog/details/os.h>
 #include <spdlog/spdlog.h>
 
 // C++ standard
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <ctime>
+#include <iterator>
 #include <utility>
 
 namespace
@@ -32,14 +43,83 @@ namespace
       spdlog::level::critical,
       spdlog::level::off,
     };
+
+    constexpr spdlog::level::level_enum BADGE_LEVELS[]{
+      spdlog::level::warn,
+      spdlog::level::err,
+      spdlog::level::critical,
+    };
+
+    constexpr size_t FORMATTED_ROWS_CACHE_SIZE = 1024;
+
+    constexpr const char* CURRENT_SESSION = "current session";
+
+    constexpr double MIB = 1024.0 * 1024.0;
+
+    constexpr float LOG_RATE_PLOT_LINES = 8.0f;
+
+    // rows measured again per frame after a layout change, the clock is read between chunks
+    constexpr std::chrono::milliseconds ROWS_MEASURE_BUDGET{2};
+    constexpr size_t ROWS_MEASURE_CHUNK = 256;
+    constexpr std::chrono::milliseconds WRAP_WIDTH_DEBOUNCE{200};
+
+    [[nodiscard]] double to_plot_time(std::chrono::sys_seconds second) noexcept
+    {
+        return static_cast<double>(second.time_since_epoch().count());
+    }
+
+    // same layout as the default spdlog pattern, "[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] %v"
+    template<typename Output>
+    Output format_prefix(Output out, std::chrono::system_clock::time_point time, std::string_view logger_name)
+    {
+        const std::tm tm = spdlog::details::os::localtime(std::chrono::system_clock::to_time_t(time));
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+        return fmt::format_to(out, "[{:%Y-%m-%d %H:%M:%S}.{:03}] [{}] [", tm, ms, logger_name);
+    }
 } // namespace
 
-LogViewer::LogViewer() noexcept
-    : _logs_colors()
+LogViewer::LogViewer(thread_pool& thread_pool) noexcept
+    : _logs(STORED_LOGS)
+    , _source_name(CURRENT_SESSION)
+    , _source_error()
+    , _source_task()
+    , _source_loading(false)
+    , _logs_colors()
     , _log_level(spdlog::level::trace)
     , _auto_scroll(true)
     , _wrap_lines(false)
-    , _logger(logging::get_logger("LogViewer"))
+    , _rows_filter()
+    , _rows_layout()
+    , _rows()
+    , _rows_offset(1, 0.0)
+    , _rows_measured(0)
+    , _rows_width(0.0f)
+    , _rows_end_sequence(0)
+    , _pending_wrap_width(-1.0f)
+    , _pending_wrap_since()
+    , _rows_prefix_width()
+    , _rows_logger_width()
+    , _formatted_rows(FORMATTED_ROWS_CACHE_SIZE)
+    , _rate_source(nullptr)
+    , _rate_buckets()
+    , _rate_xs()
+    , _rate_stacks()
+    , _rate_fit(true)
+    , _scroll_to_time()
+    , _thread_pool(thread_pool)
+    , _query_input()
+    , _query_text()
+    , _query_level(spdlog::level::trace)
+    , _query_source(nullptr)
+    , _query()
+    , _query_error()
+    , _query_task()
+    , _query_matches()
+    , _query_end_sequence(0)
+    , _query_done(false)
+    , _query_generation(0)
+    , _rows_query_matches(0)
+    , _logger(logging::static_logger<"LogViewer">())
 {
     assert(STORED_LOGS != nullptr);
 
@@ -54,6 +134,11 @@ LogViewer::LogViewer() noexcept
 
 void LogViewer::print() noexcept
 {
+    print_source_selector();
+    ImGui::SameLine();
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
+    ImGui::SameLine();
+
     const ImGuiStyle& style = GImGui->Style;
     ImGui::PushItemWidth(ImGui::CalcTextSize(spdlog::level::to_string_view(spdlog::level::critical).data()).x
                          + ImGui::GetFrameHeight() + 2 * style.ItemInnerSpacing.x);
@@ -89,49 +174,127 @@ void LogViewer::print() noexcept
     {
         SPDLOG_LOGGER_TRACE(_logger, "line wrapping ", _auto_scroll ? "enabled" : "disabled");
     }
+    ImGui::SameLine();
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
+    for(spdlog::level::level_enum level: BADGE_LEVELS)
+    {
+        const unsigned long long count = _logs->level_count(level);
+        ImGui::SameLine();
+        ImGui::PushStyleColor(ImGuiCol_Text,
+                              count == 0 ? GImGui->Style.Colors[ImGuiCol_TextDisabled] : _logs_colors[level]);
+        ImGui::Text("%s %llu", spdlog::level::to_short_c_str(level), count);
+        ImGui::PopStyleColor();
+        if(ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("%llu %s logs", count, spdlog::level::to_string_view(level).data());
+        }
+    }
+    if(const std::optional<logging::async_metrics> metrics = logging::get_async_metrics())
+    {
+        const size_t dropped = metrics->dropped_oldest + metrics->dropped_new;
+        ImGui::SameLine();
+        ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
+        ImGui::SameLine();
+        ImGui::PushStyleColor(ImGuiCol_Text,
+                              dropped == 0 ? GImGui->Style.Colors[ImGuiCol_TextDisabled]
+                                           : _logs_colors[spdlog::level::warn]);
+        ImGui::Text("queue %zu", metrics->queue_depth);
+        ImGui::PopStyleColor();
+        if(ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("%zu / %zu queued logs\n%zu oldest logs dropped\n%zu new logs dropped",
+                              metrics->queue_depth,
+                              metrics->queue_capacity,
+                              metrics->dropped_oldest,
+                              metrics->dropped_new);
+        }
+    }
+    const store_sink_mt::memory_usage memory = _logs->memory();
+    ImGui::SameLine();
+    ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
+    ImGui::SameLine();
+    ImGui::TextDisabled("%.1f MiB", static_cast<double>(memory.hot_bytes + memory.cold_bytes) / MIB);
+    if(ImGui::IsItemHovered())
+    {
+        const double ratio = memory.cold_bytes == 0 ? 1.0
+                                                    : static_cast<double>(memory.cold_records_bytes)
+                                                        / static_cast<double>(memory.cold_bytes);
+        ImGui::SetTooltip("%.1f MiB of hot segments\n%.1f MiB of compressed cold segments (ratio %.1f)",
+                          static_cast<double>(memory.hot_bytes) / MIB,
+                          static_cast<double>(memory.cold_bytes) / MIB,
+                          ratio);
+    }
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x / 2);
+    ImGui::InputTextWithHint("##query",
+                             "search, e.g. level>=warn logger:glfw since:-5m swap",
+                             _query_input.data(),
+                             _query_input.size());
+    update_query();
+    if(!_query_error.empty())
+    {
+        ImGui::SameLine();
+        ImGui::PushStyleColor(ImGuiCol_Text, _logs_colors[spdlog::level::err]);
+        ImGui::TextUnformatted(_query_error.c_str());
+        ImGui::PopStyleColor();
+    }
+    else if(_query)
+    {
+        ImGui::SameLine();
+        if(_query_done)
+        {
+            ImGui::Text("%zu matches", _rows.size());
+        }
+        else
+        {
+            ImGui::TextDisabled("searching... %zu matches", _query_matches.size());
+        }
+    }
     ImGui::Separator();
+    if(ImGui::CollapsingHeader("Log rate", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        print_log_rate();
+    }
 
     if(ImGui::BeginChild("Logs",
                          ImVec2(ImGui::GetContentRegionAvail().x, 0),
                          false,
                          _wrap_lines ? ImGuiWindowFlags_None : ImGuiWindowFlags_HorizontalScrollbar))
     {
+        // stable view, logging threads are not blocked while the records are drawn
+        const log_snapshot logs = _logs->snapshot();
+        update_rows(logs);
+
         if(_wrap_lines)
         {
             ImGui::PushTextWrapPos();
         }
-        STORED_LOGS->iterate_on_logs(
-          [this](const store_sink_mt::store_log& log)
-          {
-              if(log.level < _log_level)
-              {
-                  return true;
-              }
-              if(log.color_range_start < log.color_range_end)
-              {
-                  ImGui::TextUnformatted(log.txt.c_str(), log.txt.c_str() + log.color_range_start);
-                  ImGui::SameLine(0, 0);
-                  ImGui::PushStyleColor(ImGuiCol_Text, _logs_colors[log.level]);
-                  ImGui::TextUnformatted(log.txt.c_str() + log.color_range_start,
-                                         log.txt.c_str() + log.color_range_end);
-                  ImGui::PopStyleColor();
-                  ImGui::SameLine(0, 0);
-
-                  // cut text for better alignment when line wrapping is enabled
-                  const char* pos = log.txt.c_str() + log.color_range_end;
-                  ImGui::TextUnformatted(pos, pos + 2);
-                  if(pos + 2 < log.txt.c_str() + log.txt.size())
-                  {
-                      ImGui::SameLine(0, 0);
-                      ImGui::TextUnformatted(pos + 2, log.txt.c_str() + log.txt.size());
-                  }
-              }
-              else
-              {
-                  ImGui::TextUnformatted(log.txt.c_str());
-              }
-              return true;
-          });
+
+        // only lay out the visible rows, located by binary search in the rows offsets
+        const double origin = static_cast<double>(ImGui::GetCursorPosY());
+        if(_scroll_to_time)
+        {
+            // rows are ordered by sequence, and so almost by time
+            const auto row = std::ranges::partition_point(
+              _rows, [&](uint64_t sequence) { return logs.at(sequence).time < *_scroll_to_time; });
+            const double offset = _rows_offset[static_cast<size_t>(std::distance(_rows.begin(), row))];
+            ImGui::SetScrollY(static_cast<float>(origin + offset));
+            _auto_scroll = false;
+            _scroll_to_time.reset();
+        }
+        const double top = static_cast<double>(ImGui::GetScrollY()) - origin;
+        const double bottom = top + static_cast<double>(ImGui::GetWindowHeight());
+        // the next rows follow the first one rather than their offset: drawn right even with estimated heights
+        const auto first = std::upper_bound(_rows_offset.begin(), std::prev(_rows_offset.end()), top);
+        auto row = static_cast<size_t>(std::distance(_rows_offset.begin(), first));
+        row -= std::min(row, static_cast<size_t>(1));
+        ImGui::SetCursorPosY(static_cast<float>(origin + _rows_offset[row]));
+        for(; row < _rows.size() && static_cast<double>(ImGui::GetCursorPosY()) - origin < bottom; ++row)
+        {
+            print_log(logs.at(_rows[row]), logs);
+        }
+        ImGui::SetCursorPosY(static_cast<float>(origin + _rows_offset.back()));
+        ImGui::Dummy(ImVec2(_rows_width, 0.0f));
+
         if(_wrap_lines)
         {
             ImGui::PopTextWrapPos();
@@ -144,3 +307,464 @@ void LogViewer::print() noexcept
 
     ImGui::EndChild();
 }
+
+void LogViewer::print_log_rate()
+{
+    if(_rate_source != _logs.get())
+    {
+        _rate_source = _logs.get();
+        _rate_buckets.clear();
+        _rate_fit = true;
+    }
+
+    // the last known bucket may have been updated since
+    // (counts of older seconds received late are only seen when the source changes)
+    const std::chrono::sys_seconds since =
+      _rate_buckets.empty() ? std::chrono::sys_seconds::min() : _rate_buckets.back().second;
+    std::vector<log_rate_bucket> buckets = _logs->log_rate(since);
+    if(!buckets.empty())
+    {
+        if(!_rate_buckets.empty())
+        {
+            _rate_buckets.pop_back();
+        }
+        _rate_buckets.insert(_rate_buckets.end(), buckets.begin(), buckets.end());
+        if(_rate_buckets.size() > store_sink_mt::MAX_RATE_BUCKETS)
+        {
+            _rate_buckets.erase(_rate_buckets.begin(),
+                                std::prev(_rate_buckets.end(), store_sink_mt::MAX_RATE_BUCKETS));
+        }
+    }
+
+    constexpr ImPlotFlags plot_flags =
+      ImPlotFlags_NoTitle | ImPlotFlags_NoMenus | ImPlotFlags_NoBoxSelect | ImPlotFlags_NoMouseText;
+    if(!ImPlot::BeginPlot(
+         "##log_rate", ImVec2(-1.0f, ImGui::GetTextLineHeightWithSpacing() * LOG_RATE_PLOT_LINES), plot_flags))
+    {
+        return;
+    }
+    ImPlot::SetupAxes(nullptr, "logs/s", ImPlotAxisFlags_None, ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit);
+    ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+    ImPlot::SetupLegend(ImPlotLocation_NorthWest, ImPlotLegendFlags_Horizontal);
+    if(_rate_fit && !_rate_buckets.empty())
+    {
+        ImPlot::SetupAxisLimits(ImAxis_X1,
+                                to_plot_time(_rate_buckets.front().second),
+                                to_plot_time(_rate_buckets.back().second) + 1.0,
+                                ImPlotCond_Always);
+        _rate_fit = false;
+    }
+
+    // zoomed out, the seconds are aggregated in steps: the bars show the mean rate of their step
+    const ImPlotRect limits = ImPlot::GetPlotLimits();
+    const double step = std::max(1.0, std::ceil(limits.X.Size() / std::max(1.0f, ImPlot::GetPlotSize().x)));
+    const auto bucket_time = [](const log_rate_bucket& bucket) { return to_plot_time(bucket.second); };
+    const auto first = std::ranges::lower_bound(_rate_buckets, limits.X.Min - step, {}, bucket_time);
+    const auto last = std::ranges::upper_bound(first, _rate_buckets.end(), limits.X.Max, {}, bucket_time);
+    _rate_xs.clear();
+    for(std::vector<double>& stack: _rate_stacks)
+    {
+        stack.clear();
+    }
+    for(auto it = first; it != last; ++it)
+    {
+        const double x = std::floor(to_plot_time(it->second) / step) * step + step / 2.0;
+        if(_rate_xs.empty() || _rate_xs.back() != x)
+        {
+            _rate_xs.push_back(x);
+            for(std::vector<double>& stack: _rate_stacks)
+            {
+                stack.push_back(0.0);
+            }
+        }
+        // bars are stacked by level: each one includes the lower levels
+        double count = 0.0;
+        for(size_t l = 0; l < _rate_stacks.size(); ++l)
+        {
+            count += it->counts[l];
+            _rate_stacks[l].back() += count / step;
+        }
+    }
+
+    // highest stacks first, the lower levels are drawn over them
+    for(size_t l = _rate_stacks.size(); l-- > 0;)
+    {
+        const auto level = static_cast<spdlog::level::level_enum>(l);
+        ImPlot::SetNextFillStyle(_logs_colors[level]);
+        ImPlot::SetNextLineStyle(_logs_colors[level]);
+        ImPlot::PlotBars(spdlog::level::to_string_view(level).data(),
+                         _rate_xs.data(),
+                         _rate_stacks[l].data(),
+                         static_cast<int>(_rate_xs.size()),
+                         step);
+    }
+
+    // a click without drag jumps to the first log of the clicked bar
+    const ImGuiIO& io = ImGui::GetIO();
+    if(ImPlot::IsPlotHovered() && ImGui::IsMouseReleased(ImGuiMouseButton_Left)
+       && io.MouseDragMaxDistanceSqr[ImGuiMouseButton_Left] < io.MouseDragThreshold * io.MouseDragThreshold)
+    {
+        const auto bar_begin = static_cast<int64_t>(std::floor(ImPlot::GetPlotMousePos().x / step) * step);
+        _scroll_to_time = std::chrono::sys_seconds(std::chrono::seconds(bar_begin));
+        SPDLOG_LOGGER_TRACE(_logger, "jump to the logs of second {}", bar_begin);
+    }
+    ImPlot::EndPlot();
+}
+
+void LogViewer::update_rows(const log_snapshot& logs) noexcept
+{
+    const row_filter filter{_log_level, _query_generation, _logs.get()};
+    if(filter != _rows_filter)
+    {
+        _rows_filter = filter;
+        _rows.clear();
+        _rows_offset.assign(1, 0.0);
+        _rows_measured = 0;
+        _rows_width = 0.0f;
+        _rows_end_sequence = 0;
+        _rows_query_matches = 0;
+    }
+
+    const row_layout layout{rows_wrap_width(), ImGui::GetFontSize(), GImGui->Style.ItemSpacing.y};
+    if(layout != _rows_layout)
+    {
+        // the rows are measured again over the next frames, see measure_rows
+        _rows_layout = layout;
+        _rows_measured = 0;
+        _rows_width = 0.0f;
+
+        // time digits have the same width, any time is a good sample
+        fmt::memory_buffer prefix;
+        for(size_t l = 0; l < _rows_prefix_width.size(); ++l)
+        {
+            prefix.clear();
+            format_prefix(std::back_inserter(prefix), std::chrono::system_clock::now(), {});
+            const spdlog::string_view_t level =
+              spdlog::level::to_string_view(static_cast<spdlog::level::level_enum>(l));
+            prefix.append(level.data(), level.data() + level.size());
+            prefix.append(std::string_view("] "));
+            _rows_prefix_width[l] = ImGui::CalcTextSize(prefix.data(), prefix.data() + prefix.size()).x;
+        }
+        _rows_logger_width.clear();
+    }
+
+    // drop evicted records, every frame: rows are read while a query is still streaming
+    const auto evicted_end = std::lower_bound(_rows.begin(), _rows.end(), logs.begin_sequence());
+    if(evicted_end != _rows.begin())
+    {
+        const auto evicted_count = std::distance(_rows.begin(), evicted_end);
+        const double evicted_height = _rows_offset[static_cast<size_t>(evicted_count)];
+        _rows.erase(_rows.begin(), evicted_end);
+        _rows_offset.erase(_rows_offset.begin(), std::next(_rows_offset.begin(), evicted_count));
+        for(double& offset: _rows_offset)
+        {
+            offset -= evicted_height;
+        }
+        _rows_measured -= std::min(_rows_measured, static_cast<size_t>(evicted_count));
+    }
+    measure_rows(logs);
+
+    if(_query)
+    {
+        // matches streamed since the last frame
+        for(; _rows_query_matches < _query_matches.size(); ++_rows_query_matches)
+        {
+            const uint64_t sequence = _query_matches[_rows_query_matches];
+            if(sequence >= logs.begin_sequence())
+            {
+                add_row(logs.at(sequence), logs);
+            }
+        }
+        if(!_query_done)
+        {
+            return;
+        }
+        _rows_end_sequence = std::max(_rows_end_sequence, _query_end_sequence);
+    }
+
+    // only measure the records appended since the last frame, skipping the filtered out levels
+    logs.since(_rows_end_sequence)
+      .iterate_on_logs(_rows_filter.level,
+                       [this, &logs](const store_log& log)
+                       {
+                           if(!_query || _query->matches(log, logs))
+                           {
+                               add_row(log, logs);
+                           }
+                           return true;
+                       });
+    _rows_end_sequence = logs.end_sequence();
+}
+
+float LogViewer::rows_wrap_width() noexcept
+{
+    if(!_wrap_lines)
+    {
+        return 0.0f;
+    }
+    const float wrap_width = ImGui::GetContentRegionAvail().x;
+    if(_rows_layout.wrap_width <= 0.0f || wrap_width == _rows_layout.wrap_width)
+    {
+        _pending_wrap_width = -1.0f;
+        return wrap_width;
+    }
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(wrap_width != _pending_wrap_width)
+    {
+        _pending_wrap_width = wrap_width;
+        _pending_wrap_since = now;
+    }
+    return now - _pending_wrap_since < WRAP_WIDTH_DEBOUNCE ? _rows_layout.wrap_width : wrap_width;
+}
+
+void LogViewer::measure_rows(const log_snapshot& logs) noexcept
+{
+    if(_rows_measured == _rows.size())
+    {
+        return;
+    }
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + ROWS_MEASURE_BUDGET;
+    size_t row = _rows_measured;
+    double estimated_offset = _rows_offset[row];
+    while(row < _rows.size() && std::chrono::steady_clock::now() < deadline)
+    {
+        for(const size_t chunk_end = std::min(row + ROWS_MEASURE_CHUNK, _rows.size()); row < chunk_end; ++row)
+        {
+            const ImVec2 size = row_size(logs.at(_rows[row]), logs);
+            estimated_offset = _rows_offset[row + 1];
+            _rows_offset[row + 1] = _rows_offset[row] + static_cast<double>(size.y + _rows_layout.spacing);
+            _rows_width = std::max(_rows_width, size.x);
+        }
+    }
+    _rows_measured = row;
+
+    // the next rows keep their estimated heights
+    const double shift = _rows_offset[row] - estimated_offset;
+    if(shift != 0.0)
+    {
+        for(size_t i = row + 1; i < _rows_offset.size(); ++i)
+        {
+            _rows_offset[i] += shift;
+        }
+    }
+}
+
+void LogViewer::add_row(const store_log& log, const log_snapshot& logs) noexcept
+{
+    const ImVec2 size = row_size(log, logs);
+    if(_rows_measured == _rows.size())
+    {
+        // measured with the current layout
+        ++_rows_measured;
+    }
+    _rows.push_back(log.sequence);
+    _rows_offset.push_back(_rows_offset.back() + static_cast<double>(size.y + _rows_layout.spacing));
+    _rows_width = std::max(_rows_width, size.x);
+}
+
+void LogViewer::print_source_selector()
+{
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize(CURRENT_SESSION).x + ImGui::GetFrameHeight()
+                            + 2 * GImGui->Style.ItemInnerSpacing.x);
+    if(ImGui::BeginCombo("##source", _source_name.c_str()))
+    {
+        if(ImGui::Selectable(CURRENT_SESSION, _logs == STORED_LOGS) && _logs != STORED_LOGS)
+        {
+            _source_task = {};
+            _source_loading = false;
+            _source_error.clear();
+            _source_name = CURRENT_SESSION;
+            _logs = STORED_LOGS;
+            _formatted_rows.clear();
+        }
+        for(const spdlog::filename_t& filename: logging::previous_binary_logs())
+        {
+            font::request_glyphs(filename);
+            const bool selected = _logs != STORED_LOGS && _source_name == filename;
+            if(ImGui::Selectable(filename.c_str(), selected) && !selected)
+            {
+                load_source(filename);
+            }
+        }
+        ImGui::EndCombo();
+    }
+    if(ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("logs source, previous sessions are read from their binary log file");
+    }
+    if(_source_loading)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("loading...");
+    }
+    else if(!_source_error.empty())
+    {
+        ImGui::SameLine();
+        ImGui::PushStyleColor(ImGuiCol_Text, _logs_colors[spdlog::level::err]);
+        ImGui::TextUnformatted(_source_error.c_str());
+        ImGui::PopStyleColor();
+    }
+}
+
+void LogViewer::load_source(const spdlog::filename_t& filename)
+{
+    SPDLOG_LOGGER_DEBUG(_logger, "loading logs from {}", filename);
+    _source_loading = true;
+    _source_error.clear();
+    _source_task = _thread_pool.submit_cancellable(
+      thread_pool::priority::normal,
+      [filename](std::stop_token stop_token)
+        -> tl::expected<std::shared_ptr<store_sink_mt>, std::string>
+      {
+          // unbounded: the file was limited in size when written
+          auto logs = std::make_shared<store_sink_mt>();
+          tl::expected<size_t, std::string> records = binary_log::decode(filename, *logs, std::move(stop_token));
+          if(!records)
+          {
+              return tl::make_unexpected(std::move(records.error()));
+          }
+          return logs;
+      });
+    _source_task.then_on_ui(
+      [this, filename](tl::expected<std::shared_ptr<store_sink_mt>, std::string>&& logs)
+      {
+          _source_loading = false;
+          if(!logs)
+          {
+              SPDLOG_LOGGER_ERROR(_logger, "failed to load logs: {}", logs.error());
+              _source_error = std::move(logs.error());
+              return;
+          }
+          _source_name = filename;
+          _logs = std::move(*logs);
+          _logs->compress_cold_segments(&_thread_pool);
+          _formatted_rows.clear();
+      });
+}
+
+void LogViewer::update_query()
+{
+    const std::string_view input(_query_input.data());
+    if(input == _query_text && _log_level == _query_level && _logs.get() == _query_source)
+    {
+        return;
+    }
+    _query_text = input;
+    _query_level = _log_level;
+    _query_source = _logs.get();
+    _query_task = {};
+    _query.reset();
+    _query_error.clear();
+    _query_matches.clear();
+    _query_done = false;
+    ++_query_generation;
+
+    tl::expected<log_query, std::string> query = log_query::parse(input);
+    if(!query)
+    {
+        _query_error = std::move(query.error());
+        return;
+    }
+    if(query->empty())
+    {
+        return;
+    }
+    _query = std::move(*query);
+
+    SPDLOG_LOGGER_TRACE(_logger, "running query {}", _query_text);
+    const log_snapshot logs = _logs->snapshot();
+    _query_end_sequence = logs.end_sequence();
+    _query_task = _thread_pool.submit_cancellable(
+      thread_pool::priority::interactive,
+      [this, &pool = _thread_pool, logs, query = *_query, level = _log_level](std::stop_token stop_token)
+      {
+          run_log_query(pool,
+                        logs,
+                        query,
+                        level,
+                        stop_token,
+                        [this, &stop_token](std::vector<uint64_t>&& batch)
+                        {
+                            UI_DISPATCHER.post(
+                              [this, stop_token, batch = std::move(batch)]()
+                              {
+                                  if(!stop_token.stop_requested())
+                                  {
+                                      _query_matches.insert(_query_matches.end(), batch.begin(), batch.end());
+                                  }
+                              });
+                        });
+      });
+    _query_task.then_on_ui([this]([[maybe_unused]] task_future<void>&& result) { _query_done = true; });
+}
+
+ImVec2 LogViewer::row_size(const store_log& log, const log_snapshot& logs) noexcept
+{
+    if(log.logger_id >= _rows_logger_width.size())
+    {
+        _rows_logger_width.resize(log.logger_id + 1, -1.0f);
+    }
+    float& logger_width = _rows_logger_width[log.logger_id];
+    if(logger_width < 0.0f)
+    {
+        const std::string_view logger_name = logs.logger_name(log.logger_id);
+        logger_width = ImGui::CalcTextSize(logger_name.data(), logger_name.data() + logger_name.size()).x;
+    }
+    const float prefix_width = _rows_prefix_width[static_cast<size_t>(log.level)] + logger_width;
+
+    // the payload is drawn as a block after the prefix, see print_log
+    const char* begin = log.payload.data();
+    const char* end = log.payload.data() + log.payload.size();
+    const float wrap_width = _rows_layout.wrap_width;
+    if(wrap_width <= 0.0f)
+    {
+        const ImVec2 payload = ImGui::CalcTextSize(begin, end);
+        return {prefix_width + payload.x, std::max(payload.y, _rows_layout.font_size)};
+    }
+    const ImVec2 payload = ImGui::CalcTextSize(begin, end, false, std::max(wrap_width - prefix_width, 1.0f));
+    return {wrap_width, std::max(payload.y, _rows_layout.font_size)};
+}
+
+const LogViewer::formatted_row& LogViewer::format_row(const store_log& log, const log_snapshot& logs)
+{
+    if(const formatted_row* row = _formatted_rows.find(log.sequence))
+    {
+        return *row;
+    }
+    formatted_row row;
+    format_prefix(std::back_inserter(row.txt), log.time, logs.logger_name(log.logger_id));
+    const spdlog::string_view_t level = spdlog::level::to_string_view(log.level);
+    row.level_begin = static_cast<uint16_t>(row.txt.size());
+    row.txt.append(level.data(), level.size());
+    row.level_end = static_cast<uint16_t>(row.txt.size());
+    row.txt.append("] ");
+    row.txt.append(log.payload);
+    font::request_glyphs(row.txt);
+    return _formatted_rows.insert(log.sequence, std::move(row));
+}
+
+void LogViewer::print_log(const store_log& log, const log_snapshot& logs) noexcept
+{
+    const formatted_row& row = format_row(log, logs);
+    const char* begin = row.txt.data();
+    const char* end = row.txt.data() + row.txt.size();
+    ImGui::TextUnformatted(begin, begin + row.level_begin);
+    ImGui::SameLine(0, 0);
+    ImGui::PushStyleColor(ImGuiCol_Text, _logs_colors[log.level]);
+    ImGui::TextUnformatted(begin + row.level_begin, begin + row.level_end);
+    ImGui::PopStyleColor();
+    ImGui::SameLine(0, 0);
+
+    // cut text for better alignment when line wrapping is enabled
+    const char* payload = begin + row.level_end + 2;
+    ImGui::TextUnformatted(begin + row.level_end, payload);
+    if(payload < end)
+    {
+        ImGui::SameLine(0, 0);
+        ImGui::TextUnformatted(payload, end);
+    }
+    if(ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal))
+    {
+        ImGui::SetTooltip("thread %u", static_cast<unsigned int>(log.thread_id));
+    }
+}
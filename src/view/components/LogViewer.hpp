@@ -7,30 +7,143 @@
 //
 #pragma once
 
+// project
+#include <utils/log_query.hpp>
+#include <utils/log_snapshot.hpp>
+#include <utils/lru_cache.hpp>
+#include <utils/store_sink.hpp>
+#include <utils/task_handle.hpp>
+#include <utils/thread_pool.hpp>
+
 // external
 #include <imgui.h>
 #include <spdlog/logger.h>
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 class LogViewer
 {
 public:
-    LogViewer() noexcept;
+    // queries and source loads run on thread_pool, their results are delivered to this: not movable
+    explicit LogViewer(thread_pool& thread_pool) noexcept;
 
-    LogViewer(const LogViewer&) = default;
-    LogViewer(LogViewer&&) noexcept = default;
-    LogViewer& operator=(const LogViewer&) = default;
-    LogViewer& operator=(LogViewer&&) noexcept = default;
+    LogViewer(const LogViewer&) = delete;
+    LogViewer(LogViewer&&) noexcept = delete;
+    LogViewer& operator=(const LogViewer&) = delete;
+    LogViewer& operator=(LogViewer&&) noexcept = delete;
 
     ~LogViewer() noexcept = default;
 
     void print() noexcept;
 
 private:
+    // displayed rows depend on these
+    struct row_filter
+    {
+        spdlog::level::level_enum level = spdlog::level::trace;
+        uint64_t query_generation = 0;
+        const store_sink_mt* source = nullptr;
+
+        bool operator==(const row_filter&) const noexcept = default;
+    };
+
+    // rows cached measures depend on these
+    struct row_layout
+    {
+        float wrap_width = -1.0f;
+        float font_size = 0.0f;
+        float spacing = 0.0f;
+
+        bool operator==(const row_layout&) const noexcept = default;
+    };
+
+    // "[time] [logger] [level] payload", with the level range colored
+    struct formatted_row
+    {
+        std::string txt;
+        uint16_t level_begin = 0;
+        uint16_t level_end = 0;
+    };
+
+    void print_source_selector();
+    void load_source(const spdlog::filename_t& filename);
+    void update_query();
+    void print_log_rate();
+    void update_rows(const log_snapshot& logs) noexcept;
+    [[nodiscard]] float rows_wrap_width() noexcept;
+    void measure_rows(const log_snapshot& logs) noexcept;
+    void add_row(const store_log& log, const log_snapshot& logs) noexcept;
+    [[nodiscard]] ImVec2 row_size(const store_log& log, const log_snapshot& logs) noexcept;
+    [[nodiscard]] const formatted_row& format_row(const store_log& log, const log_snapshot& logs);
+    void print_log(const store_log& log, const log_snapshot& logs) noexcept;
+
+    // displayed logs: the current session ones or the ones of a binary log file loaded on thread_pool
+    std::shared_ptr<store_sink_mt> _logs;
+    std::string _source_name;
+    std::string _source_error;
+    task_handle<tl::expected<std::shared_ptr<store_sink_mt>, std::string>> _source_task;
+    bool _source_loading;
+
     std::unordered_map<spdlog::level::level_enum, ImVec4> _logs_colors;
     spdlog::level::level_enum _log_level;
 
     bool _auto_scroll;
     bool _wrap_lines;
 
+    // displayed records sequences, with the prefix sum of their heights (one more offset than rows)
+    // offsets are doubles, a float loses sub-pixel precision past 2^24 px: converted when given to ImGui only
+    row_filter _rows_filter;
+    row_layout _rows_layout;
+    std::vector<uint64_t> _rows;
+    std::vector<double> _rows_offset;
+    // on a layout change, the rows from this one keep their previous height as an estimate until measured again
+    size_t _rows_measured;
+    float _rows_width;
+    uint64_t _rows_end_sequence;
+
+    // while the window is resized, a new wrap width is applied once it stopped changing
+    float _pending_wrap_width;
+    std::chrono::steady_clock::time_point _pending_wrap_since;
+
+    // rows are measured without being formatted: prefix width by level plus logger name width by id
+    std::array<float, spdlog::level::n_levels> _rows_prefix_width;
+    std::vector<float> _rows_logger_width;
+
+    // only the drawn rows are formatted
+    lru_cache<uint64_t, formatted_row> _formatted_rows;
+
+    // logs per second of the source, only the new buckets are copied each frame
+    // the visible buckets are aggregated in stacked bars, one per pixel at most
+    const store_sink_mt* _rate_source;
+    std::vector<log_rate_bucket> _rate_buckets;
+    std::vector<double> _rate_xs;
+    std::array<std::vector<double>, spdlog::level::n_levels> _rate_stacks;
+    bool _rate_fit;
+    std::optional<std::chrono::sys_seconds> _scroll_to_time;
+
+    // query matches are streamed from thread_pool, the records after the queried snapshot are matched
+    // when added to the rows, a new query cancels the running one
+    thread_pool& _thread_pool;
+    std::array<char, 256> _query_input;
+    std::string _query_text;
+    spdlog::level::level_enum _query_level;
+    const store_sink_mt* _query_source;
+    std::optional<log_query> _query;
+    std::string _query_error;
+    task_handle<void> _query_task;
+    std::vector<uint64_t> _query_matches;
+    uint64_t _query_end_sequence;
+    bool _query_done;
+    uint64_t _query_generation;
+    size_t _rows_query_matches;
+
     std::shared_ptr<spdlog::logger> _logger;
 };
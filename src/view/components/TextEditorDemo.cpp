@@ -10,6 +10,7 @@
 #include "TextEditorDemo.hpp"
 
 // project
+#include <view/font.hpp>
 #include <view/style/colors.hpp>
 
 // external
@@ -155,6 +156,8 @@ void TextEditorDemo::open_file(const std::string& path)
         text.assign((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
         stream.close();
 
+        font::request_glyphs(path);
+        font::request_glyphs(text);
         original_text = text;
         editor.SetText(text);
         version = editor.GetUndoIndex();
@@ -25,7 +25,7 @@ TextEditorStyleEditor::TextEditorStyleEditor(const TextEditor::Palette& text_edi
     , _base_text_editor_palette(text_editor_palette)
     , _text_editor_palette(text_editor_palette)
     , _example_editor()
-    , _logger(logging::get_logger("StyleEditor"))
+    , _logger(logging::static_logger<"StyleEditor">())
 {
     _example_editor.SetReadOnlyEnabled(true);
     _example_editor.SetLanguage(TextEditor::Language::Cpp());
@@ -10,18 +10,35 @@
 #include "font.hpp"
 
 // project
+#include <utils/config.hpp>
 #include <utils/log.hpp>
+#include <utils/task_future.hpp>
+#include <utils/thread_pool.hpp>
+#include <view/font_cache.hpp>
+#include <view/font_sdf.hpp>
 
 // external
 #include <IconsFontAwesome6.h>
+#include <backends/imgui_impl_opengl3.h>
 #include <compiled_fonts.h>
+#include <fmt/compile.h>
+#include <fmt/format.h>
 #include <imgui.h>
+#include <imgui_internal.h>
 
 // C++ standard
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <stack>
 #include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace
 {
@@ -35,14 +52,18 @@ namespace
     {
         font::embedded font = font::DEFAULT_FONT;
         float size = font::DEFAULT_FONT_SIZE;
+        bool icons = true;
 
-        font_id(font::embedded _font, float _size) noexcept : font(_font), size(_size)
+        font_id(font::embedded _font, float _size, bool _icons = true) noexcept
+            : font(_font)
+            , size(_size)
+            , icons(_icons)
         {
         }
 
         bool operator==(const font_id& rhs) const noexcept
         {
-            return std::tie(font, size) == std::tie(rhs.font, rhs.size);
+            return std::tie(font, size, icons) == std::tie(rhs.font, rhs.size, rhs.icons);
         }
 
         bool operator!=(const font_id& rhs) const noexcept
@@ -55,19 +76,102 @@ namespace
     {
         size_t operator()(const font_id& id) const noexcept
         {
-            return std::hash<font::embedded>{}(id.font) ^ std::hash<float>{}(id.size);
+            return std::hash<font::embedded>{}(id.font) ^ std::hash<float>{}(id.size) ^ std::hash<bool>{}(id.icons);
         }
     };
 
+    struct pushed_font
+    {
+        font_id id;
+        ImFont* font = nullptr;
+        // restored on pop, SDF fonts are scaled to the pushed size
+        float previous_scale = 1.0f;
+    };
+
+    // atlas built with a list of fonts, on the UI thread or on a thread pool worker
+    struct atlas_build
+    {
+        std::vector<font_id> fonts{};
+        font::rendering rendering = font::rendering::BITMAP;
+        // must outlive the atlas
+        std::vector<ImWchar> glyph_ranges{};
+        std::unique_ptr<ImFontAtlas> atlas{};
+        uint64_t key = 0;
+        std::filesystem::path cache_path{};
+        // ImFont of each of the fonts
+        std::vector<ImFont*> loaded_fonts{};
+        bool restored = false;
+        bool cached = false;
+        // the SDF build failed and the bitmap fonts were built instead
+        bool sdf_failed = false;
+    };
+
     struct font_info
     {
         std::mutex fonts_mutex{};
         std::unordered_map<font_id, ImFont*, font_id_hash> loaded_fonts{};
-        std::stack<font_id> fonts_stack{};
+        std::stack<pushed_font> fonts_stack{};
+        // atlas of the ImGui context, with the fonts, ranges and rendering it was built with
+        std::unique_ptr<ImFontAtlas> atlas = std::make_unique<ImFontAtlas>();
+        std::vector<font_id> atlas_fonts{};
+        std::vector<ImWchar> atlas_glyph_ranges{};
+        font::rendering atlas_rendering = font::rendering::BITMAP;
+        font::rendering rendering = font::rendering::BITMAP;
+        // fonts pushed before being loaded, added at the next frame
+        std::vector<font_id> pending_fonts{};
+        std::unordered_map<const unsigned int*, uint64_t> data_hashes{};
+        // cache files used by this run, the other ones are outdated
+        std::vector<std::filesystem::path> used_cache_files{};
+
+        // atlas builds not restored from the cache run on the pool, one at a time
+        thread_pool* pool = nullptr;
+        task_future<atlas_build> background_build{};
+        std::vector<font_id> background_fonts{};
+
+        // codepoints requested so far, the atlas is rebuilt at the next frame when some are added
+        ImFontGlyphRangesBuilder requested_glyphs{};
+        bool glyphs_pending = false;
+
+        size_t builds = 0;
+        size_t cache_restores = 0;
     };
 
     font_info DATA;
 
+    // Latin-1 with ASCII, ellipsis and replacement character: the UI strings
+    constexpr ImWchar BASE_GLYPHS_RANGES[] = {0x0020, 0x00FF, 0x2026, 0x2026, 0xFFFD, 0xFFFD, 0};
+    constexpr ImWchar ICONS_RANGES[] = {ICON_MIN_FA, ICON_MAX_16_FA, 0};
+    constexpr float ICONS_SCALE = 0.9f;
+
+    // FNV-1a
+    class hasher
+    {
+    public:
+        void add(const void* data, size_t size) noexcept
+        {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            for(size_t i = 0; i < size; ++i)
+            {
+                _value = (_value ^ bytes[i]) * 0x100000001b3;
+            }
+        }
+
+        template<typename T>
+        void add(const T& value) noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            add(&value, sizeof(T));
+        }
+
+        [[nodiscard]] uint64_t value() const noexcept
+        {
+            return _value;
+        }
+
+    private:
+        uint64_t _value = 0xcbf29ce484222325;
+    };
+
     [[nodiscard]] font_data get_data(font::embedded font) noexcept
     {
         switch(font)
@@ -90,59 +194,419 @@ namespace
         assert(false);
     }
 
+    [[nodiscard]] font_data get_icons_data() noexcept
+    {
+        return {FontAwesome6_solid_compressed_data, FontAwesome6_solid_compressed_size};
+    }
+
+    // content hash of embedded font data, computed once
+    [[nodiscard]] uint64_t data_hash(font_data data) noexcept
+    {
+        auto [it, inserted] = DATA.data_hashes.try_emplace(data.data);
+        if(inserted)
+        {
+            hasher hash;
+            hash.add(data.data, data.size);
+            it->second = hash.value();
+        }
+        return it->second;
+    }
+
+    // font of the atlas rendering a requested font: itself, or its face at the SDF size
+    [[nodiscard]] font_id atlas_font(const font_id& id, font::rendering rendering) noexcept
+    {
+        if(rendering == font::rendering::SDF)
+        {
+            return {id.font, font_sdf::FONT_SIZE, id.icons};
+        }
+        return id;
+    }
+
+    [[nodiscard]] std::vector<font_id> atlas_fonts(const atlas_build& build)
+    {
+        std::vector<font_id> fonts;
+        for(const font_id& id: build.fonts)
+        {
+            const font_id added = atlas_font(id, build.rendering);
+            if(std::ranges::find(fonts, added) == fonts.end())
+            {
+                fonts.push_back(added);
+            }
+        }
+        return fonts;
+    }
+
+    // identifies the atlas content: fonts data, sizes, ranges and build parameters
+    [[nodiscard]] uint64_t atlas_key(const atlas_build& build)
+    {
+        hasher hash;
+        hash.add(IMGUI_VERSION_NUM);
+        hash.add(sizeof(ImFontGlyph));
+        hash.add(build.rendering);
+        hash.add(build.atlas->Flags);
+        hash.add(build.atlas->TexDesiredWidth);
+        hash.add(build.atlas->TexGlyphPadding);
+        hash.add(build.glyph_ranges.data(), build.glyph_ranges.size() * sizeof(ImWchar));
+        hash.add(ICONS_RANGES);
+        hash.add(ICONS_SCALE);
+        hash.add(data_hash(get_icons_data()));
+        for(const font_id& id: atlas_fonts(build))
+        {
+            hash.add(data_hash(get_data(id.font)));
+            hash.add(id.size);
+            hash.add(id.icons);
+        }
+        return hash.value();
+    }
+
+    // add a font whose data is only needed by Build(): a restored atlas doesn't read it
+    [[nodiscard]] ImFont* add_font(ImFontAtlas& atlas, font_data data, ImFontConfig config, bool cached)
+    {
+        if(!cached)
+        {
+            return atlas.AddFontFromMemoryCompressedTTF(
+              data.data, static_cast<int>(data.size), config.SizePixels, &config, config.GlyphRanges);
+        }
+        static constexpr unsigned char placeholder = 0;
+        config.FontData = const_cast<unsigned char*>(&placeholder);
+        config.FontDataSize = 1;
+        config.FontDataOwnedByAtlas = false;
+        return atlas.AddFont(&config);
+    }
+
+    // add the fonts of the build merged with the icons, return false if one failed to load
+    // SDF fonts are only placeholders: font_sdf::build() rasterizes them
+    bool add_fonts(atlas_build& build, bool cached)
+    {
+        const std::shared_ptr<spdlog::logger>& logger = logging::static_logger<"font">();
+        ImFontAtlas& atlas = *build.atlas;
+        const bool sdf = build.rendering == font::rendering::SDF;
+        const std::vector<font_id> fonts = atlas_fonts(build);
+        std::vector<ImFont*> added_fonts;
+        bool complete = true;
+        for(const font_id& id: fonts)
+        {
+            ImFontConfig font_config;
+            font_config.SizePixels = id.size;
+            font_config.GlyphRanges = build.glyph_ranges.data();
+            ImFont* base_font = add_font(atlas, get_data(id.font), font_config, cached || sdf);
+            if(base_font)
+            {
+                SPDLOG_LOGGER_DEBUG(logger, "Loaded font DroidSans {:.2f}px", id.size);
+            }
+            else
+            {
+                base_font = atlas.AddFontDefault();
+                complete = false;
+                SPDLOG_LOGGER_WARN(logger, "Failed to load font DroidSans: use default font instead");
+            }
+
+            if(!id.icons || sdf)
+            {
+                added_fonts.push_back(base_font);
+                continue;
+            }
+            ImFontConfig icons_config;
+            icons_config.SizePixels = id.size * ICONS_SCALE;
+            icons_config.GlyphRanges = ICONS_RANGES;
+            icons_config.MergeMode = true;
+            icons_config.PixelSnapH = true;
+            icons_config.GlyphMinAdvanceX = id.size;
+            ImFont* merged_font = add_font(atlas, get_icons_data(), icons_config, cached);
+            if(merged_font)
+            {
+                SPDLOG_LOGGER_DEBUG(logger, "Loaded font FontAwesome6-solid {:.2f}px", icons_config.SizePixels);
+            }
+            else
+            {
+                merged_font = base_font;
+                complete = false;
+                SPDLOG_LOGGER_WARN(logger, "Failed to load FontAwesome6-solid: icons disabled");
+            }
+            added_fonts.push_back(merged_font);
+        }
+
+        build.loaded_fonts.clear();
+        for(const font_id& id: build.fonts)
+        {
+            const auto it = std::ranges::find(fonts, atlas_font(id, build.rendering));
+            build.loaded_fonts.push_back(added_fonts[static_cast<size_t>(std::distance(fonts.begin(), it))]);
+        }
+        return complete;
+    }
+
+    // sources of the SDF fonts, in the order add_fonts() adds them
+    [[nodiscard]] std::vector<std::vector<font_sdf::source>> sdf_sources(const atlas_build& build)
+    {
+        std::vector<std::vector<font_sdf::source>> sources;
+        for(const font_id& id: atlas_fonts(build))
+        {
+            const font_data data = get_data(id.font);
+            std::vector<font_sdf::source>& font_sources = sources.emplace_back();
+            font_sources.push_back({data.data, data.size, build.glyph_ranges.data()});
+            if(id.icons)
+            {
+                const font_data icons_data = get_icons_data();
+                font_sources.push_back({icons_data.data, icons_data.size, ICONS_RANGES, ICONS_SCALE, 1.0f});
+            }
+        }
+        return sources;
+    }
+
+    void remove_unused_cache_files(const std::filesystem::path& folder) noexcept
+    {
+        std::error_code ignored;
+        for(const auto& entry: std::filesystem::directory_iterator(folder, ignored))
+        {
+            if(std::ranges::find(DATA.used_cache_files, entry.path()) == DATA.used_cache_files.end())
+            {
+                std::filesystem::remove(entry.path(), ignored);
+            }
+        }
+    }
+
     // Warning: not thread safe, doesn't lock m_mutex
-    [[nodiscard]] ImFont* load_font(font::embedded font, float size)
+    // new build with the current and pending fonts and glyphs, with its cache file
+    [[nodiscard]] atlas_build prepare_build()
     {
-        std::shared_ptr<spdlog::logger> logger = logging::get_logger("font");
-        ImGuiIO& io = ImGui::GetIO();
+        atlas_build build;
+        build.fonts = DATA.atlas_fonts;
+        build.fonts.insert(build.fonts.end(), DATA.pending_fonts.begin(), DATA.pending_fonts.end());
+        DATA.pending_fonts.clear();
+
+        DATA.requested_glyphs.AddRanges(BASE_GLYPHS_RANGES);
+        ImVector<ImWchar> ranges;
+        DATA.requested_glyphs.BuildRanges(&ranges);
+        build.glyph_ranges.assign(ranges.begin(), ranges.end());
+        DATA.glyphs_pending = false;
 
-        static constexpr ImWchar font_ranges[] = {0x0001, 0xFFFF, 0};
-        font_data data = get_data(font);
-        ImFont* base_font =
-          io.Fonts->AddFontFromMemoryCompressedTTF(data.data, static_cast<int>(data.size), size, nullptr, font_ranges);
-        if(base_font)
+        build.rendering = DATA.rendering;
+        build.atlas = std::make_unique<ImFontAtlas>();
+        build.atlas->Flags = DATA.atlas->Flags;
+        // anti-aliased lines baked in the atlas would be thresholded by the SDF shader
+        if(build.rendering == font::rendering::SDF)
         {
-            SPDLOG_LOGGER_DEBUG(logger, "Loaded font DroidSans {:.2f}px", size);
+            build.atlas->Flags |= ImFontAtlasFlags_NoBakedLines;
         }
         else
         {
-            base_font = io.Fonts->AddFontDefault();
-            SPDLOG_LOGGER_WARN(logger, "Failed to load font DroidSans: use default font instead");
+            build.atlas->Flags &= ~ImFontAtlasFlags_NoBakedLines;
         }
-        io.Fonts->Build();
+        build.atlas->TexDesiredWidth = DATA.atlas->TexDesiredWidth;
+        build.atlas->TexGlyphPadding = DATA.atlas->TexGlyphPadding;
+        build.key = atlas_key(build);
+        build.cache_path = std::filesystem::path(config::fonts::get_atlas_cache_folder_path())
+                           / fmt::format(FMT_COMPILE("{:016x}.atlas"), build.key);
+        return build;
+    }
 
-        const float icon_size = size * 0.9f;
-        static constexpr ImWchar icons_ranges[] = {ICON_MIN_FA, ICON_MAX_16_FA, 0};
-        ImFontConfig icons_config;
-        icons_config.MergeMode = true;
-        icons_config.PixelSnapH = true;
-        icons_config.GlyphMinAdvanceX = size;
-        ImFont* merged_font =
-          io.Fonts->AddFontFromMemoryCompressedTTF(FontAwesome6_solid_compressed_data,
-                                                   static_cast<int>(FontAwesome6_solid_compressed_size),
-                                                   icon_size,
-                                                   &icons_config,
-                                                   icons_ranges);
-        if(merged_font)
+    // restore the atlas from its cache file if any, else build and cache it
+    // only touches the build: safe to run on a worker, ImGui allocations aside which only update metrics
+    void run_build(atlas_build& build)
+    {
+        const std::shared_ptr<spdlog::logger>& logger = logging::static_logger<"font">();
+        ImFontAtlas& atlas = *build.atlas;
+        const auto start = std::chrono::steady_clock::now();
+        const auto elapsed_ms = [&start] {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        std::error_code ignored;
+        if(std::filesystem::exists(build.cache_path, ignored))
         {
-            SPDLOG_LOGGER_DEBUG(logger, "Loaded font FontAwesome6-solid {:.2f}px", icon_size);
+            add_fonts(build, true);
+            if(tl::expected<void, std::string> res = font_cache::load(atlas, build.cache_path, build.key))
+            {
+                build.restored = true;
+                SPDLOG_LOGGER_DEBUG(logger,
+                                    "Font atlas {}x{} restored from cache in {:.1f}ms",
+                                    atlas.TexWidth,
+                                    atlas.TexHeight,
+                                    elapsed_ms());
+                return;
+            }
+            else
+            {
+                SPDLOG_LOGGER_WARN(logger, "Failed to restore font atlas from cache: {}", res.error());
+            }
+            atlas.Clear();
         }
-        else
+
+        const bool complete = add_fonts(build, false);
+        if(build.rendering != font::rendering::SDF)
+        {
+            atlas.Build();
+        }
+        else if(tl::expected<void, std::string> res = font_sdf::build(atlas, sdf_sources(build)); !res)
+        {
+            SPDLOG_LOGGER_WARN(logger, "Failed to build SDF font atlas, use bitmap fonts instead: {}", res.error());
+            atlas.Clear();
+            build.rendering = font::rendering::BITMAP;
+            build.sdf_failed = true;
+            add_fonts(build, false);
+            atlas.Build();
+            return;
+        }
+        SPDLOG_LOGGER_DEBUG(
+          logger, "Font atlas {}x{} built in {:.1f}ms", atlas.TexWidth, atlas.TexHeight, elapsed_ms());
+        if(!complete)
+        {
+            return;
+        }
+        if(tl::expected<void, std::string> res = font_cache::save(atlas, build.cache_path, build.key); !res)
         {
-            SPDLOG_LOGGER_WARN(logger, "Failed to load FontAwesome6-solid: icons disabled");
-            merged_font = base_font;
+            SPDLOG_LOGGER_WARN(logger, "Failed to cache font atlas: {}", res.error());
+            return;
         }
-        io.Fonts->Build();
+        build.cached = true;
+    }
 
-        DATA.loaded_fonts[{font, size}] = merged_font;
-        static bool first_loaded_font = true;
-        if(first_loaded_font)
+    // Warning: not thread safe, doesn't lock m_mutex
+    // the built atlas replaces the one of the ImGui context, between frames
+    void adopt_build(atlas_build&& build)
+    {
+        ImGuiIO& io = ImGui::GetIO();
+        const bool uploaded = io.Fonts->TexID != ImTextureID{};
+        if(uploaded)
         {
-            // first loaded font is default font
-            DATA.fonts_stack.emplace(font, size);
-            first_loaded_font = false;
+            ImGui_ImplOpenGL3_DestroyFontsTexture();
+        }
+        io.Fonts = build.atlas.get();
+        DATA.atlas = std::move(build.atlas);
+        DATA.atlas_fonts = std::move(build.fonts);
+        DATA.atlas_glyph_ranges = std::move(build.glyph_ranges);
+        DATA.loaded_fonts.clear();
+        for(size_t i = 0; i < DATA.atlas_fonts.size(); ++i)
+        {
+            DATA.loaded_fonts[DATA.atlas_fonts[i]] = build.loaded_fonts[i];
+        }
+        DATA.atlas_rendering = build.rendering;
+        if(build.sdf_failed)
+        {
+            // not retried
+            DATA.rendering = font::rendering::BITMAP;
+        }
+        if(DATA.atlas_rendering == font::rendering::SDF)
+        {
+            // outside of push(), a face is rendered at the size it was first requested with: the default size for the
+            // default font, which is the first one
+            for(auto it = DATA.atlas_fonts.rbegin(); it != DATA.atlas_fonts.rend(); ++it)
+            {
+                ImFont* loaded_font = DATA.loaded_fonts[*it];
+                loaded_font->Scale = it->size / loaded_font->FontSize;
+            }
+        }
+        if(uploaded)
+        {
+            ImGui_ImplOpenGL3_CreateFontsTexture();
+        }
+
+        ++(build.restored ? DATA.cache_restores : DATA.builds);
+        DATA.used_cache_files.push_back(build.cache_path);
+        if(build.cached)
+        {
+            remove_unused_cache_files(build.cache_path.parent_path());
         }
-        return merged_font;
+    }
+
+    // Warning: not thread safe, doesn't lock m_mutex
+    // single rebuild for all the pending fonts and glyphs
+    // restored right away when cached, else built on the pool if any: the current atlas is used until then
+    void rebuild_atlas()
+    {
+        if(DATA.background_build.valid())
+        {
+            // requests are kept pending until the running build is adopted
+            return;
+        }
+        atlas_build build = prepare_build();
+        std::error_code ignored;
+        if(DATA.pool == nullptr || std::filesystem::exists(build.cache_path, ignored))
+        {
+            run_build(build);
+            adopt_build(std::move(build));
+            return;
+        }
+        SPDLOG_LOGGER_DEBUG(logging::static_logger<"font">(), "Font atlas build started in background");
+        DATA.background_fonts = build.fonts;
+        DATA.background_build = DATA.pool->submit(thread_pool::priority::interactive,
+                                                  [build = std::move(build)]() mutable
+                                                  {
+                                                      run_build(build);
+                                                      return std::move(build);
+                                                  });
+    }
+
+    // Warning: not thread safe, doesn't lock m_mutex
+    // adopt the background build once done
+    void poll_background_build()
+    {
+        if(!DATA.background_build.valid() || !DATA.background_build.ready())
+        {
+            return;
+        }
+        adopt_build(DATA.background_build.get());
+        DATA.background_fonts.clear();
+    }
+
+    // Warning: not thread safe, doesn't lock m_mutex
+    // return false if the font is already loaded or pending
+    bool queue_font(const font_id& id)
+    {
+        if(DATA.loaded_fonts.contains(id) || std::ranges::find(DATA.pending_fonts, id) != DATA.pending_fonts.end()
+           || std::ranges::find(DATA.background_fonts, id) != DATA.background_fonts.end())
+        {
+            return false;
+        }
+        DATA.pending_fonts.push_back(id);
+        return true;
+    }
+
+    // Warning: not thread safe, doesn't lock m_mutex
+    // a font not loaded yet is queued, and replaced by the loaded size of the same font closest to it meanwhile
+    [[nodiscard]] ImFont* find_font(const font_id& id)
+    {
+        if(auto it = DATA.loaded_fonts.find(id); it != DATA.loaded_fonts.end())
+        {
+            return it->second;
+        }
+        ImFont* closest = nullptr;
+        float closest_distance = 0.0f;
+        for(const auto& [loaded_id, loaded_font]: DATA.loaded_fonts)
+        {
+            const float distance = std::abs(loaded_id.size - id.size);
+            if(loaded_id.font == id.font && loaded_id.icons == id.icons && (!closest || distance < closest_distance))
+            {
+                closest = loaded_font;
+                closest_distance = distance;
+            }
+        }
+        if(closest && DATA.atlas_rendering == font::rendering::SDF)
+        {
+            // the SDF font of the face renders any size: no rebuild
+            DATA.loaded_fonts.emplace(id, closest);
+            DATA.atlas_fonts.push_back(id);
+            return closest;
+        }
+        if(queue_font(id))
+        {
+            SPDLOG_LOGGER_DEBUG(logging::static_logger<"font">(), "Font {:.2f}px queued for next frame", id.size);
+        }
+        // nullptr is the default font
+        return closest;
+    }
+
+    // Warning: not thread safe, doesn't lock m_mutex
+    void push_font(const font_id& id)
+    {
+        ImFont* loaded_font = find_font(id);
+        const float previous_scale = loaded_font ? loaded_font->Scale : 1.0f;
+        if(loaded_font && DATA.atlas_rendering == font::rendering::SDF)
+        {
+            loaded_font->Scale = id.size / loaded_font->FontSize;
+        }
+        ImGui::PushFont(loaded_font);
+        DATA.fonts_stack.push({id, loaded_font, previous_scale});
     }
 } // namespace
 
@@ -161,29 +625,52 @@ font::guard::~guard() noexcept
     pop();
 }
 
-void font::preload(embedded font, float size) noexcept
+ImFontAtlas* font::atlas() noexcept
 {
     std::lock_guard guard(DATA.fonts_mutex);
-    ImFont* imgui_font = DATA.loaded_fonts[{font, size}];
-    if(imgui_font != nullptr)
+    return DATA.atlas.get();
+}
+
+void font::set_build_pool(thread_pool* pool) noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    if(pool == nullptr && DATA.background_build.valid())
     {
-        return;
+        // the running build must not outlive its pool
+        DATA.background_build.wait();
+        poll_background_build();
     }
-    imgui_font = load_font(font, size);
-    // ImGui::SFML::UpdateFontTexture();
+    DATA.pool = pool;
 }
 
-void font::push(embedded font, float size) noexcept
+void font::preload(embedded font, float size) noexcept
+{
+    preload_batch({{font, size}});
+}
+
+void font::preload_batch(std::initializer_list<request> requests) noexcept
 {
     std::lock_guard guard(DATA.fonts_mutex);
-    ImFont* imgui_font = DATA.loaded_fonts[{font, size}];
-    if(imgui_font == nullptr)
+    for(const request& requested: requests)
     {
-        imgui_font = load_font(font, size);
-        // ImGui::SFML::UpdateFontTexture();
+        const font_id id(requested.font, requested.size, requested.icons);
+        if(DATA.fonts_stack.empty())
+        {
+            // first loaded font is default font
+            DATA.fonts_stack.push({id});
+        }
+        queue_font(id);
     }
-    DATA.fonts_stack.emplace(font, size);
-    ImGui::PushFont(imgui_font);
+    if(!DATA.pending_fonts.empty())
+    {
+        rebuild_atlas();
+    }
+}
+
+void font::push(embedded font, float size) noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    push_font(font_id(font, size));
 }
 
 void font::push(float size) noexcept
@@ -192,21 +679,100 @@ void font::push(float size) noexcept
     embedded font = DEFAULT_FONT;
     if(!DATA.fonts_stack.empty())
     {
-        font = DATA.fonts_stack.top().font;
+        font = DATA.fonts_stack.top().id.font;
     }
-    ImFont* imgui_font = DATA.loaded_fonts[{font, size}];
-    if(imgui_font == nullptr)
-    {
-        imgui_font = load_font(font, size);
-        // ImGui::SFML::UpdateFontTexture();
-    }
-    DATA.fonts_stack.emplace(font, size);
-    ImGui::PushFont(imgui_font);
+    push_font(font_id(font, size));
 }
 
 void font::pop() noexcept
 {
     std::lock_guard guard(DATA.fonts_mutex);
+    // restored before ImGui sets the previous font size from it
+    const pushed_font& pushed = DATA.fonts_stack.top();
+    if(pushed.font)
+    {
+        pushed.font->Scale = pushed.previous_scale;
+    }
     DATA.fonts_stack.pop();
     ImGui::PopFont();
 }
+
+void font::set_rendering(rendering mode) noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    DATA.rendering = mode;
+}
+
+void font::request_glyphs(std::string_view text) noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    const char* it = text.data();
+    const char* end = text.data() + text.size();
+    while(it < end)
+    {
+        // ASCII is always loaded
+        if(static_cast<unsigned char>(*it) < 0x80)
+        {
+            ++it;
+            continue;
+        }
+        unsigned int c = 0;
+        it += ImTextCharFromUtf8(&c, it, end);
+        if(c <= IM_UNICODE_CODEPOINT_MAX && !DATA.requested_glyphs.GetBit(c))
+        {
+            DATA.requested_glyphs.SetBit(c);
+            DATA.glyphs_pending = true;
+        }
+    }
+}
+
+void font::new_frame() noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    poll_background_build();
+
+    // characters typed since the last frame, still queued: ImGui only reads its input events in ImGui::NewFrame()
+    for(const ImGuiInputEvent& event: GImGui->InputEventsQueue)
+    {
+        if(event.Type == ImGuiInputEventType_Text && event.Text.Char <= IM_UNICODE_CODEPOINT_MAX
+           && !DATA.requested_glyphs.GetBit(event.Text.Char))
+        {
+            DATA.requested_glyphs.SetBit(event.Text.Char);
+            DATA.glyphs_pending = true;
+        }
+    }
+    // the fonts, glyphs and rendering requested during the last frame are applied with a single rebuild
+    const bool rendering_pending = DATA.rendering != DATA.atlas_rendering;
+    if(DATA.pending_fonts.empty() && ((!DATA.glyphs_pending && !rendering_pending) || DATA.atlas_fonts.empty()))
+    {
+        return;
+    }
+    rebuild_atlas();
+}
+
+void font::prepare_render(ImDrawData* draw_data) noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    if(draw_data != nullptr && DATA.atlas_rendering == rendering::SDF)
+    {
+        font_sdf::prepare_render(*draw_data, DATA.atlas->TexID);
+    }
+}
+
+font::atlas_stats font::stats() noexcept
+{
+    std::lock_guard guard(DATA.fonts_mutex);
+    const ImFontAtlas& atlas = *DATA.atlas;
+    atlas_stats stats;
+    stats.width = atlas.TexWidth;
+    stats.height = atlas.TexHeight;
+    for(const ImFont* font: atlas.Fonts)
+    {
+        stats.glyphs += static_cast<size_t>(font->Glyphs.Size);
+    }
+    stats.builds = DATA.builds;
+    stats.cache_restores = DATA.cache_restores;
+    stats.building = DATA.background_build.valid();
+    stats.sdf = DATA.atlas_rendering == rendering::SDF;
+    return stats;
+}
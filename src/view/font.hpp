@@ -10,6 +10,15 @@
 // external
 #include <spdlog/spdlog.h>
 
+// C++ standard
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+class thread_pool;
+struct ImDrawData;
+struct ImFontAtlas;
+
 namespace font
 {
     constexpr float DEFAULT_FONT_SIZE = 15.0f;
@@ -26,6 +35,31 @@ namespace font
     };
     constexpr embedded DEFAULT_FONT = embedded::DROID_SANS_MONO;
 
+    enum class rendering
+    {
+        BITMAP, // one font rasterized per size
+        SDF // one signed distance field font per face, rendered at any size by a shader
+    };
+
+    struct atlas_stats
+    {
+        int width = 0;
+        int height = 0;
+        size_t glyphs = 0;
+        size_t builds = 0;
+        size_t cache_restores = 0;
+        bool building = false;
+        bool sdf = false;
+    };
+
+    struct request
+    {
+        embedded font = DEFAULT_FONT;
+        float size = DEFAULT_FONT_SIZE;
+        // merge the FontAwesome icons in the font
+        bool icons = true;
+    };
+
     struct guard
     {
         explicit guard(embedded font, float size = DEFAULT_FONT_SIZE) noexcept;
@@ -33,10 +67,39 @@ namespace font
         ~guard() noexcept;
     };
 
+    // atlas to create the ImGui context with, io.Fonts is replaced on each atlas rebuild
+    [[nodiscard]] ImFontAtlas* atlas() noexcept;
+
+    // atlas builds not restored from the cache run on pool, nullptr builds on the calling thread
+    // until a background build is done, the previous atlas is used: ImGui default font for the first one
+    void set_build_pool(thread_pool* pool) noexcept;
+
     // first loaded font will be default font (when no font is pushed)
     void preload(embedded font, float size = DEFAULT_FONT_SIZE) noexcept;
 
+    // build the atlas once for all the requested fonts, outside of a frame
+    void preload_batch(std::initializer_list<request> requests) noexcept;
+
+    // a font not loaded yet is replaced by the closest loaded size until the atlas rebuilt at the next frame has it
+    // with SDF rendering, any size of a loaded font is rendered right away
     void push(embedded font, float size = DEFAULT_FONT_SIZE) noexcept;
     void push(float size) noexcept;
     void pop() noexcept;
+
+    // applied at the next frame, BITMAP by default
+    void set_rendering(rendering mode) noexcept;
+
+    // the atlas starts with ASCII, Latin-1 and the few other characters of the UI strings, and the typed characters
+    // are added to it: the text from other sources (log records, files...) must be requested to have its glyphs
+    // the missing glyphs of the text requested during a frame are added at the next one, with a single atlas rebuild
+    void request_glyphs(std::string_view text) noexcept;
+
+    // apply the pending atlas changes, before starting the ImGui frame
+    void new_frame() noexcept;
+
+    // with SDF rendering, set the SDF shader for the text of the draw data
+    // between ImGui::Render() and ImGui_ImplOpenGL3_RenderDrawData()
+    void prepare_render(ImDrawData* draw_data) noexcept;
+
+    [[nodiscard]] atlas_stats stats() noexcept;
 } // namespace font
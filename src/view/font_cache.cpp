@@ -0,0 +1,220 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "font_cache.hpp"
+
+// project
+#include <utils/mapped_file.hpp>
+#include <utils/path_utils.hpp>
+
+// external
+#include <fmt/compile.h>
+#include <fmt/format.h>
+#include <imgui_internal.h>
+
+// C++ standard
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    // file layout: header, custom rects positions, fonts metrics, glyphs of each font, then the alpha8 texture
+    struct header
+    {
+        static constexpr uint64_t MAGIC = 0x31544154'4E465554; // "TUFNTAT1"
+
+        uint64_t magic;
+        uint64_t key;
+        uint32_t tex_width;
+        uint32_t tex_height;
+        uint32_t rects_count;
+        uint32_t fonts_count;
+    };
+
+    struct rect_position
+    {
+        unsigned short x;
+        unsigned short y;
+    };
+
+    struct font_metrics
+    {
+        float size;
+        float ascent;
+        float descent;
+        uint32_t glyphs_count;
+    };
+
+    static_assert(std::is_trivially_copyable_v<ImFontGlyph>);
+
+    template<typename T>
+    void write(std::ofstream& file, const T* values, size_t count)
+    {
+        file.write(reinterpret_cast<const char*>(values), static_cast<std::streamsize>(count * sizeof(T)));
+    }
+} // namespace
+
+tl::expected<void, std::string> font_cache::load(ImFontAtlas& atlas, const std::filesystem::path& path, uint64_t key)
+{
+    const std::string path_str = path_to_generic_utf8_string(path);
+    std::error_code error;
+    const uintmax_t file_size = std::filesystem::file_size(path, error);
+    if(error)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to read {}: {}"), path_str, error.message()));
+    }
+    tl::expected<mapped_file, std::string> file = mapped_file::open(path, static_cast<size_t>(file_size));
+    if(!file)
+    {
+        return tl::make_unexpected(std::move(file.error()));
+    }
+
+    const std::span<const std::byte> data(file->data(), file->size());
+    size_t offset = 0;
+    const auto read = [&](void* destination, size_t size) {
+        if(size > data.size() - offset)
+        {
+            return false;
+        }
+        std::memcpy(destination, data.data() + offset, size);
+        offset += size;
+        return true;
+    };
+
+    header file_header{};
+    if(!read(&file_header, sizeof(file_header)) || file_header.magic != header::MAGIC || file_header.key != key)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is not a cache of this atlas"), path_str));
+    }
+
+    // default custom rects (white pixel, mouse cursors, lines) are registered here, as Build() would
+    ImFontAtlasBuildInit(&atlas);
+    if(file_header.fonts_count != static_cast<uint32_t>(atlas.Fonts.Size)
+       || file_header.rects_count != static_cast<uint32_t>(atlas.CustomRects.Size))
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} does not match the atlas fonts"), path_str));
+    }
+    std::vector<rect_position> rects(file_header.rects_count);
+    std::vector<font_metrics> fonts(file_header.fonts_count);
+    if(!read(rects.data(), rects.size() * sizeof(rect_position))
+       || !read(fonts.data(), fonts.size() * sizeof(font_metrics)))
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is truncated"), path_str));
+    }
+    size_t remaining = static_cast<size_t>(file_header.tex_width) * file_header.tex_height;
+    for(const font_metrics& metrics: fonts)
+    {
+        remaining += metrics.glyphs_count * sizeof(ImFontGlyph);
+    }
+    if(remaining != data.size() - offset)
+    {
+        return tl::make_unexpected(fmt::format(FMT_COMPILE("{} is truncated"), path_str));
+    }
+
+    // from here the reads can't fail
+    for(int i = 0; i < atlas.Fonts.Size; ++i)
+    {
+        const font_metrics& metrics = fonts[static_cast<size_t>(i)];
+        ImFont* font = atlas.Fonts[i];
+        font->ClearOutputData();
+        font->FontSize = metrics.size;
+        font->ContainerAtlas = &atlas;
+        font->Ascent = metrics.ascent;
+        font->Descent = metrics.descent;
+        font->Glyphs.resize(static_cast<int>(metrics.glyphs_count));
+        read(font->Glyphs.Data, metrics.glyphs_count * sizeof(ImFontGlyph));
+        font->DirtyLookupTables = true;
+    }
+    for(int i = 0; i < atlas.CustomRects.Size; ++i)
+    {
+        atlas.CustomRects[i].X = rects[static_cast<size_t>(i)].x;
+        atlas.CustomRects[i].Y = rects[static_cast<size_t>(i)].y;
+    }
+
+    atlas.ClearTexData();
+    atlas.TexID = ImTextureID{};
+    atlas.TexWidth = static_cast<int>(file_header.tex_width);
+    atlas.TexHeight = static_cast<int>(file_header.tex_height);
+    atlas.TexUvScale = ImVec2(1.0f / static_cast<float>(atlas.TexWidth), 1.0f / static_cast<float>(atlas.TexHeight));
+    const size_t pixels = static_cast<size_t>(atlas.TexWidth) * static_cast<size_t>(atlas.TexHeight);
+    atlas.TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(pixels));
+    read(atlas.TexPixelsAlpha8, pixels);
+
+    // white pixel, lines and lookup tables, as at the end of Build()
+    ImFontAtlasBuildFinish(&atlas);
+    atlas.TexReady = true;
+    return {};
+}
+
+tl::expected<void, std::string> font_cache::save(const ImFontAtlas& atlas,
+                                                 const std::filesystem::path& path,
+                                                 uint64_t key)
+{
+    if(!atlas.IsBuilt() || atlas.TexPixelsAlpha8 == nullptr)
+    {
+        return tl::make_unexpected("font atlas is not built");
+    }
+
+    std::vector<rect_position> rects;
+    rects.reserve(static_cast<size_t>(atlas.CustomRects.Size));
+    for(const ImFontAtlasCustomRect& rect: atlas.CustomRects)
+    {
+        rects.push_back({rect.X, rect.Y});
+    }
+    std::vector<font_metrics> fonts;
+    fonts.reserve(static_cast<size_t>(atlas.Fonts.Size));
+    for(const ImFont* font: atlas.Fonts)
+    {
+        fonts.push_back({font->FontSize, font->Ascent, font->Descent, static_cast<uint32_t>(font->Glyphs.Size)});
+    }
+    const header file_header{
+      header::MAGIC,
+      key,
+      static_cast<uint32_t>(atlas.TexWidth),
+      static_cast<uint32_t>(atlas.TexHeight),
+      static_cast<uint32_t>(rects.size()),
+      static_cast<uint32_t>(fonts.size()),
+    };
+
+    // written aside then renamed: a cache file is always complete
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if(!file)
+        {
+            return tl::make_unexpected(
+              fmt::format(FMT_COMPILE("failed to open {}"), path_to_generic_utf8_string(temporary_path)));
+        }
+        write(file, &file_header, 1);
+        write(file, rects.data(), rects.size());
+        write(file, fonts.data(), fonts.size());
+        for(const ImFont* font: atlas.Fonts)
+        {
+            write(file, font->Glyphs.Data, static_cast<size_t>(font->Glyphs.Size));
+        }
+        write(file, atlas.TexPixelsAlpha8, static_cast<size_t>(atlas.TexWidth) * static_cast<size_t>(atlas.TexHeight));
+        if(!file)
+        {
+            return tl::make_unexpected(
+              fmt::format(FMT_COMPILE("failed to write {}"), path_to_generic_utf8_string(temporary_path)));
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if(error)
+    {
+        return tl::make_unexpected(fmt::format(
+          FMT_COMPILE("failed to rename to {}: {}"), path_to_generic_utf8_string(path), error.message()));
+    }
+    return {};
+}
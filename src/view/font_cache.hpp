@@ -0,0 +1,32 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// external
+#include <imgui.h>
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// On-disk copy of a built font atlas: texture, custom rectangles positions and glyph tables of its fonts.
+// A cached atlas only matches an atlas with the same fonts added in the same order, which the key has to identify.
+namespace font_cache
+{
+    // restore the cached atlas instead of building it: fonts must be added, their data is not read
+    [[nodiscard]] tl::expected<void, std::string> load(ImFontAtlas& atlas,
+                                                       const std::filesystem::path& path,
+                                                       uint64_t key);
+
+    // atlas must be built
+    [[nodiscard]] tl::expected<void, std::string> save(const ImFontAtlas& atlas,
+                                                       const std::filesystem::path& path,
+                                                       uint64_t key);
+} // namespace font_cache
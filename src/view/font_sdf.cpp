@@ -0,0 +1,571 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// header
+#include "font_sdf.hpp"
+
+// project
+#include <utils/log.hpp>
+
+// external
+#include <fmt/compile.h>
+#include <fmt/format.h>
+#include <glad/gl.h>
+#include <imgui_internal.h>
+
+// private implementations, as in imgui_draw.cpp
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <imstb_truetype.h>
+
+// C++ standard
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+    // distance fields spread over PADDING pixels around the glyph edge, which has the ON_EDGE value
+    constexpr int SDF_PADDING = 4;
+    constexpr unsigned char SDF_ON_EDGE = 128;
+    constexpr float SDF_PIXEL_DIST_SCALE = static_cast<float>(SDF_ON_EDGE) / static_cast<float>(SDF_PADDING);
+
+    // as in ImFontAtlasBuildWithStbTruetype
+    constexpr int TEX_HEIGHT_MAX = 1024 * 32;
+
+    struct font_metrics
+    {
+        float ascent = 0.0f;
+        float descent = 0.0f;
+    };
+
+    struct glyph
+    {
+        size_t font = 0;
+        unsigned int codepoint = 0;
+        int width = 0;
+        int height = 0;
+        // from the pen position on the baseline to the top left of the distance field
+        int x_offset = 0;
+        int y_offset = 0;
+        float advance = 0.0f;
+        float min_advance = 0.0f;
+        std::vector<unsigned char> distances{};
+    };
+
+    // the OpenGL3 backend shaders, with the alpha computed from the distance in the font texture
+    constexpr const char* VERTEX_SHADER = R"(#version 330 core
+uniform mat4 ProjMtx;
+in vec2 Position;
+in vec2 UV;
+in vec4 Color;
+out vec2 Frag_UV;
+out vec4 Frag_Color;
+void main()
+{
+    Frag_UV = UV;
+    Frag_Color = Color;
+    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);
+}
+)";
+
+    constexpr const char* FRAGMENT_SHADER = R"(#version 330 core
+uniform sampler2D Texture;
+uniform float Edge;
+in vec2 Frag_UV;
+in vec4 Frag_Color;
+out vec4 Out_Color;
+void main()
+{
+    float distance = texture(Texture, Frag_UV.st).a;
+    // one screen pixel wide anti-aliasing at any scale
+    float width = max(fwidth(distance), 1e-4);
+    float alpha = clamp((distance - Edge) / width + 0.5, 0.0, 1.0);
+    Out_Color = vec4(Frag_Color.rgb, Frag_Color.a * alpha);
+}
+)";
+
+    struct shader_info
+    {
+        // backend program the SDF program was linked for: same vertex attributes locations, same projection
+        GLuint backend_program = 0;
+        GLint backend_projection = -1;
+        // 0 if the link failed
+        GLuint program = 0;
+        GLint projection = -1;
+        GLint texture = -1;
+        GLint edge = -1;
+    };
+
+    shader_info SHADER;
+
+    // stb_compress format of the embedded fonts (binary_to_compressed_c), as decompressed by ImGui
+    [[nodiscard]] std::vector<unsigned char> decompress(const unsigned char* in, size_t in_size)
+    {
+        const auto read = [in](size_t position, size_t bytes) {
+            uint32_t value = 0;
+            for(size_t i = 0; i < bytes; ++i)
+            {
+                value = (value << 8) | in[position + i];
+            }
+            return value;
+        };
+        if(in_size < 16 || read(0, 4) != 0x57bC0000 || read(4, 4) != 0)
+        {
+            return {};
+        }
+
+        std::vector<unsigned char> out(read(8, 4));
+        size_t i = 16;
+        size_t o = 0;
+        // copy of previous output, may overlap with the copied bytes
+        const auto match = [&](size_t distance, size_t length) {
+            if(distance > o || length > out.size() - o)
+            {
+                return false;
+            }
+            for(; length > 0; --length, ++o)
+            {
+                out[o] = out[o - distance];
+            }
+            return true;
+        };
+        const auto literal = [&](size_t position, size_t length) {
+            if(position + length > in_size || length > out.size() - o)
+            {
+                return false;
+            }
+            std::memcpy(out.data() + o, in + position, length);
+            o += length;
+            i = position + length;
+            return true;
+        };
+
+        // the longest token and the end marker are 6 bytes
+        while(i + 6 <= in_size)
+        {
+            const unsigned char token = in[i];
+            bool valid = false;
+            if(token >= 0x80)
+            {
+                valid = match(in[i + 1] + 1u, token - 0x80u + 1);
+                i += 2;
+            }
+            else if(token >= 0x40)
+            {
+                valid = match(read(i, 2) - 0x4000 + 1, in[i + 2] + 1u);
+                i += 3;
+            }
+            else if(token >= 0x20)
+            {
+                valid = literal(i + 1, token - 0x20u + 1);
+            }
+            else if(token >= 0x18)
+            {
+                valid = match(read(i, 3) - 0x180000 + 1, in[i + 3] + 1u);
+                i += 4;
+            }
+            else if(token >= 0x10)
+            {
+                valid = match(read(i, 3) - 0x100000 + 1, read(i + 3, 2) + 1);
+                i += 5;
+            }
+            else if(token >= 0x08)
+            {
+                valid = literal(i + 2, read(i, 2) - 0x0800 + 1);
+            }
+            else if(token == 0x07)
+            {
+                valid = literal(i + 3, read(i + 1, 2) + 1);
+            }
+            else if(token == 0x06)
+            {
+                valid = match(read(i + 1, 3) + 1, in[i + 4] + 1u);
+                i += 5;
+            }
+            else if(token == 0x04)
+            {
+                valid = match(read(i + 1, 3) + 1, read(i + 4, 2) + 1);
+                i += 6;
+            }
+            else if(token == 0x05 && in[i + 1] == 0xfa)
+            {
+                // end marker and Adler-32 checksum of the output
+                uint32_t a = 1;
+                uint32_t b = 0;
+                for(const unsigned char c: out)
+                {
+                    a = (a + c) % 65521;
+                    b = (b + a) % 65521;
+                }
+                if(o != out.size() || ((b << 16) | a) != read(i + 2, 4))
+                {
+                    return {};
+                }
+                return out;
+            }
+            if(!valid)
+            {
+                return {};
+            }
+        }
+        return {};
+    }
+
+    [[nodiscard]] glyph rasterize(const stbtt_fontinfo& info, float scale, int index, const font_sdf::source& source)
+    {
+        glyph rasterized;
+        int advance = 0;
+        int left_side_bearing = 0;
+        stbtt_GetGlyphHMetrics(&info, index, &advance, &left_side_bearing);
+        rasterized.advance = static_cast<float>(advance) * scale;
+        rasterized.min_advance = source.min_advance * font_sdf::FONT_SIZE;
+
+        int width = 0;
+        int height = 0;
+        int x_offset = 0;
+        int y_offset = 0;
+        unsigned char* distances = stbtt_GetGlyphSDF(
+          &info, scale, index, SDF_PADDING, SDF_ON_EDGE, SDF_PIXEL_DIST_SCALE, &width, &height, &x_offset, &y_offset);
+        // nullptr for glyphs without outline (e.g. space)
+        if(distances != nullptr)
+        {
+            rasterized.width = width;
+            rasterized.height = height;
+            rasterized.x_offset = x_offset;
+            rasterized.y_offset = y_offset;
+            rasterized.distances.assign(distances, distances + static_cast<ptrdiff_t>(width) * height);
+            stbtt_FreeSDF(distances, nullptr);
+        }
+        return rasterized;
+    }
+
+    // Warning: must run with the OpenGL context current
+    [[nodiscard]] GLuint compile(GLenum type, const char* source)
+    {
+        const GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if(status != GL_TRUE)
+        {
+            std::array<char, 1024> log{};
+            glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, log.data());
+            SPDLOG_LOGGER_ERROR(logging::static_logger<"font">(), "Failed to compile SDF shader: {}", log.data());
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    // Warning: must run with the OpenGL context current
+    // SDF program reading the vertex attributes at the locations of the backend program
+    void link(GLuint backend_program)
+    {
+        SHADER.backend_program = backend_program;
+        SHADER.backend_projection = glGetUniformLocation(backend_program, "ProjMtx");
+        if(SHADER.program != 0)
+        {
+            glDeleteProgram(SHADER.program);
+            SHADER.program = 0;
+        }
+
+        const GLuint vertex_shader = compile(GL_VERTEX_SHADER, VERTEX_SHADER);
+        const GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+        if(vertex_shader == 0 || fragment_shader == 0)
+        {
+            glDeleteShader(vertex_shader);
+            glDeleteShader(fragment_shader);
+            return;
+        }
+        const GLuint program = glCreateProgram();
+        glAttachShader(program, vertex_shader);
+        glAttachShader(program, fragment_shader);
+        for(const char* attribute: {"Position", "UV", "Color"})
+        {
+            if(const GLint location = glGetAttribLocation(backend_program, attribute); location >= 0)
+            {
+                glBindAttribLocation(program, static_cast<GLuint>(location), attribute);
+            }
+        }
+        glLinkProgram(program);
+        glDetachShader(program, vertex_shader);
+        glDetachShader(program, fragment_shader);
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if(status != GL_TRUE)
+        {
+            std::array<char, 1024> log{};
+            glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, log.data());
+            SPDLOG_LOGGER_ERROR(logging::static_logger<"font">(), "Failed to link SDF shader: {}", log.data());
+            glDeleteProgram(program);
+            return;
+        }
+        SHADER.program = program;
+        SHADER.projection = glGetUniformLocation(program, "ProjMtx");
+        SHADER.texture = glGetUniformLocation(program, "Texture");
+        SHADER.edge = glGetUniformLocation(program, "Edge");
+    }
+
+    // draw callback, called by the backend with its program in use
+    void use_shader(const ImDrawList*, const ImDrawCmd*)
+    {
+        GLint current_program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current_program);
+        const auto backend_program = static_cast<GLuint>(current_program);
+        if(backend_program != SHADER.backend_program)
+        {
+            link(backend_program);
+        }
+        if(SHADER.program == 0)
+        {
+            return;
+        }
+
+        std::array<GLfloat, 16> projection{};
+        glGetUniformfv(backend_program, SHADER.backend_projection, projection.data());
+        glUseProgram(SHADER.program);
+        glUniformMatrix4fv(SHADER.projection, 1, GL_FALSE, projection.data());
+        glUniform1i(SHADER.texture, 0);
+        glUniform1f(SHADER.edge, static_cast<float>(SDF_ON_EDGE) / 255.0f);
+    }
+
+    [[nodiscard]] ImDrawCmd callback_command(const ImDrawCmd& command, ImDrawCallback callback) noexcept
+    {
+        ImDrawCmd call = command;
+        call.ElemCount = 0;
+        call.UserCallback = callback;
+        call.UserCallbackData = nullptr;
+        return call;
+    }
+} // namespace
+
+tl::expected<void, std::string> font_sdf::build(ImFontAtlas& atlas, std::span<const std::vector<source>> fonts)
+{
+    if(fonts.size() != static_cast<size_t>(atlas.Fonts.Size))
+    {
+        return tl::make_unexpected("SDF sources don't match the atlas fonts");
+    }
+    atlas.ClearTexData();
+    // default custom rects (white pixel, mouse cursors, lines), as Build() would
+    ImFontAtlasBuildInit(&atlas);
+
+    std::vector<font_metrics> metrics(fonts.size());
+    std::vector<glyph> glyphs;
+    for(size_t i = 0; i < fonts.size(); ++i)
+    {
+        // the first source with a glyph for a codepoint provides it, as with ImGui merged fonts
+        ImFontGlyphRangesBuilder added;
+        for(size_t j = 0; j < fonts[i].size(); ++j)
+        {
+            const source& font_source = fonts[i][j];
+            const std::vector<unsigned char> data = decompress(
+              reinterpret_cast<const unsigned char*>(font_source.compressed_data), font_source.compressed_size);
+            stbtt_fontinfo info;
+            if(data.empty() || !stbtt_InitFont(&info, data.data(), stbtt_GetFontOffsetForIndex(data.data(), 0)))
+            {
+                return tl::make_unexpected(fmt::format(FMT_COMPILE("failed to load source {} of font {}"), j, i));
+            }
+            const float scale = stbtt_ScaleForPixelHeight(&info, FONT_SIZE * font_source.scale);
+            if(j == 0)
+            {
+                int ascent = 0;
+                int descent = 0;
+                int line_gap = 0;
+                stbtt_GetFontVMetrics(&info, &ascent, &descent, &line_gap);
+                metrics[i].ascent = std::ceil(static_cast<float>(ascent) * scale);
+                metrics[i].descent = std::floor(static_cast<float>(descent) * scale);
+            }
+            for(const ImWchar* range = font_source.glyph_ranges; range[0] != 0; range += 2)
+            {
+                for(unsigned int c = range[0]; c <= range[1]; ++c)
+                {
+                    if(added.GetBit(c))
+                    {
+                        continue;
+                    }
+                    const int index = stbtt_FindGlyphIndex(&info, static_cast<int>(c));
+                    if(index == 0)
+                    {
+                        continue;
+                    }
+                    added.SetBit(c);
+                    glyph& rasterized = glyphs.emplace_back(rasterize(info, scale, index, font_source));
+                    rasterized.font = i;
+                    rasterized.codepoint = c;
+                }
+            }
+        }
+    }
+
+    // pack the custom rects then the glyphs, texture width chosen as ImGui does
+    const int padding = atlas.TexGlyphPadding;
+    std::vector<stbrp_rect> rects(glyphs.size());
+    size_t surface = 0;
+    for(const ImFontAtlasCustomRect& rect: atlas.CustomRects)
+    {
+        surface += static_cast<size_t>(rect.Width + padding) * static_cast<size_t>(rect.Height + padding);
+    }
+    for(size_t i = 0; i < glyphs.size(); ++i)
+    {
+        // glyphs without outline take no space
+        if(glyphs[i].distances.empty())
+        {
+            continue;
+        }
+        rects[i].w = glyphs[i].width + padding;
+        rects[i].h = glyphs[i].height + padding;
+        surface += static_cast<size_t>(rects[i].w) * static_cast<size_t>(rects[i].h);
+    }
+    const float surface_sqrt = std::sqrt(static_cast<float>(surface)) + 1.0f;
+    atlas.TexWidth = 512;
+    for(const int width: {4096, 2048, 1024})
+    {
+        if(surface_sqrt >= static_cast<float>(width) * 0.7f)
+        {
+            atlas.TexWidth = width;
+            break;
+        }
+    }
+    if(atlas.TexDesiredWidth > 0)
+    {
+        atlas.TexWidth = atlas.TexDesiredWidth;
+    }
+    atlas.TexHeight = 0;
+    std::vector<stbrp_node> nodes(static_cast<size_t>(atlas.TexWidth));
+    stbrp_context context;
+    stbrp_init_target(&context, atlas.TexWidth, TEX_HEIGHT_MAX, nodes.data(), static_cast<int>(nodes.size()));
+    ImFontAtlasBuildPackCustomRects(&atlas, &context);
+    if(!rects.empty())
+    {
+        stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+    }
+    for(const stbrp_rect& rect: rects)
+    {
+        if(!rect.was_packed)
+        {
+            return tl::make_unexpected(
+              fmt::format(FMT_COMPILE("{} glyphs don't fit in a {}px wide texture"), glyphs.size(), atlas.TexWidth));
+        }
+        atlas.TexHeight = std::max(atlas.TexHeight, rect.y + rect.h);
+    }
+    atlas.TexHeight = (atlas.Flags & ImFontAtlasFlags_NoPowerOfTwoHeight) ? atlas.TexHeight + 1
+                                                                           : ImUpperPowerOfTwo(atlas.TexHeight);
+    atlas.TexUvScale = ImVec2(1.0f / static_cast<float>(atlas.TexWidth), 1.0f / static_cast<float>(atlas.TexHeight));
+    const size_t pixels = static_cast<size_t>(atlas.TexWidth) * static_cast<size_t>(atlas.TexHeight);
+    atlas.TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(pixels));
+    std::memset(atlas.TexPixelsAlpha8, 0, pixels);
+
+    for(size_t i = 0; i < fonts.size(); ++i)
+    {
+        ImFont* font = atlas.Fonts[static_cast<int>(i)];
+        font->ClearOutputData();
+        font->FontSize = FONT_SIZE;
+        font->ContainerAtlas = &atlas;
+        font->Ascent = metrics[i].ascent;
+        font->Descent = metrics[i].descent;
+    }
+    for(size_t i = 0; i < glyphs.size(); ++i)
+    {
+        const glyph& rasterized = glyphs[i];
+        const stbrp_rect& rect = rects[i];
+        for(int row = 0; row < rasterized.height; ++row)
+        {
+            std::memcpy(atlas.TexPixelsAlpha8 + static_cast<size_t>(rect.y + row) * static_cast<size_t>(atlas.TexWidth)
+                          + static_cast<size_t>(rect.x),
+                        rasterized.distances.data() + static_cast<size_t>(row) * static_cast<size_t>(rasterized.width),
+                        static_cast<size_t>(rasterized.width));
+        }
+
+        ImFont* font = atlas.Fonts[static_cast<int>(rasterized.font)];
+        // the config only clamps and centers the advance
+        ImFontConfig glyph_config;
+        glyph_config.GlyphMinAdvanceX = rasterized.min_advance;
+        const float x0 = static_cast<float>(rasterized.x_offset);
+        const float y0 = static_cast<float>(rasterized.y_offset) + IM_ROUND(font->Ascent);
+        const ImVec2 uv0(static_cast<float>(rect.x) * atlas.TexUvScale.x,
+                         static_cast<float>(rect.y) * atlas.TexUvScale.y);
+        const ImVec2 uv1(static_cast<float>(rect.x + rasterized.width) * atlas.TexUvScale.x,
+                         static_cast<float>(rect.y + rasterized.height) * atlas.TexUvScale.y);
+        font->AddGlyph(&glyph_config,
+                       static_cast<ImWchar>(rasterized.codepoint),
+                       x0,
+                       y0,
+                       x0 + static_cast<float>(rasterized.width),
+                       y0 + static_cast<float>(rasterized.height),
+                       uv0.x,
+                       uv0.y,
+                       uv1.x,
+                       uv1.y,
+                       rasterized.advance);
+    }
+
+    // white pixel, mouse cursors and lookup tables, as at the end of Build()
+    ImFontAtlasBuildFinish(&atlas);
+    atlas.TexReady = true;
+    return {};
+}
+
+void font_sdf::prepare_render(ImDrawData& draw_data, ImTextureID atlas_texture)
+{
+    // program in use when the next command is drawn, across the draw lists as the backend doesn't reset it
+    enum class program
+    {
+        BACKEND,
+        SDF,
+        UNKNOWN // after a user callback
+    };
+    program current = program::BACKEND;
+
+    ImVector<ImDrawCmd> commands;
+    for(ImDrawList* draw_list: draw_data.CmdLists)
+    {
+        commands.resize(0);
+        commands.reserve(draw_list->CmdBuffer.Size + 2);
+        for(const ImDrawCmd& command: draw_list->CmdBuffer)
+        {
+            if(command.UserCallback != nullptr)
+            {
+                commands.push_back(command);
+                current = command.UserCallback == ImDrawCallback_ResetRenderState ? program::BACKEND
+                                                                                   : program::UNKNOWN;
+                continue;
+            }
+
+            // glyphs, and shapes using the white pixel of the atlas which keeps its alpha through the shader
+            if(command.GetTexID() == atlas_texture)
+            {
+                if(current == program::UNKNOWN)
+                {
+                    commands.push_back(callback_command(command, ImDrawCallback_ResetRenderState));
+                }
+                if(current != program::SDF)
+                {
+                    commands.push_back(callback_command(command, &use_shader));
+                    current = program::SDF;
+                }
+            }
+            else if(current != program::BACKEND)
+            {
+                commands.push_back(callback_command(command, ImDrawCallback_ResetRenderState));
+                current = program::BACKEND;
+            }
+            commands.push_back(command);
+        }
+        draw_list->CmdBuffer.swap(commands);
+    }
+}
@@ -0,0 +1,46 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+#pragma once
+
+// external
+#include <imgui.h>
+#include <tl/expected.hpp>
+
+// C++ standard
+#include <span>
+#include <string>
+#include <vector>
+
+// Signed distance field fonts: glyphs are rasterized once as distance fields and rendered at any size by a shader
+// thresholding the distance, in place of the alpha blending of the OpenGL3 backend shader.
+namespace font_sdf
+{
+    // size the distance fields are rasterized at, fonts are scaled from it
+    constexpr float FONT_SIZE = 32.0f;
+
+    // stb compressed TrueType font merged in an SDF font
+    struct source
+    {
+        const unsigned int* compressed_data = nullptr;
+        unsigned int compressed_size = 0;
+        const ImWchar* glyph_ranges = nullptr;
+        // relative to FONT_SIZE
+        float scale = 1.0f;
+        // relative to FONT_SIZE, narrower glyphs are centered
+        float min_advance = 0.0f;
+    };
+
+    // build the atlas with one SDF font per sources list, the first source gives the font metrics
+    // the fonts must be added to the atlas in the same order, their data is not read
+    [[nodiscard]] tl::expected<void, std::string> build(ImFontAtlas& atlas,
+                                                        std::span<const std::vector<source>> fonts);
+
+    // render the draw commands using the texture of an SDF atlas with the SDF shader
+    // between ImGui::Render() and ImGui_ImplOpenGL3_RenderDrawData(), the OpenGL context current
+    void prepare_render(ImDrawData& draw_data, ImTextureID atlas_texture);
+} // namespace font_sdf
@@ -24,8 +24,7 @@ namespace
 
 static void glfw_error_callback(int error, const char* description)
 {
-    const std::shared_ptr<spdlog::logger> logger = logging::get_logger("glfw");
-    logger->error("glfw error {}: {}", error, description);
+    logging::static_logger<"glfw">()->error("glfw error {}: {}", error, description);
 }
 
 glfw_handle_t setup::glfw() noexcept
@@ -36,7 +35,7 @@ glfw_handle_t setup::glfw() noexcept
         return context;
     }
 
-    const std::shared_ptr<spdlog::logger> logger = logging::get_logger("glfw");
+    const std::shared_ptr<spdlog::logger>& logger = logging::static_logger<"glfw">();
 
     glfwSetErrorCallback(glfw_error_callback);
     if(!glfwInit())
@@ -11,6 +11,7 @@
 
 // project
 #include <utils/config.hpp>
+#include <view/font.hpp>
 #include <view/style/colors.hpp>
 #include <view/style/imgui.hpp>
 
@@ -39,9 +40,9 @@ imgui_handle_t setup::imgui(const main_window_handle_t& main_window_handle) noex
         return context;
     }
 
-    // Create ImGui context
+    // Create ImGui context, the font module owns its atlas
     IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
+    ImGui::CreateContext(font::atlas());
 
     // Setup Platform/Renderer bindings
     ImGui_ImplGlfw_InitForOpenGL(main_window_handle->glf_window, true);
@@ -28,6 +28,10 @@ implot_handle_t setup::implot() noexcept
     // Create implot context
     ImPlot::CreateContext();
 
+    // same time format as the logs
+    ImPlot::GetStyle().UseLocalTime = true;
+    ImPlot::GetStyle().Use24HourClock = true;
+
     // register context
     context.reset(new implot_context());
     implot_existing_context = context;
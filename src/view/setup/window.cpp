@@ -38,7 +38,7 @@ setup::main_window(const glfw_handle_t& glfw_handle, std::string_view name, size
     }
 
     {
-        std::shared_ptr<spdlog::logger> glfw_logger = logging::get_logger("glfw");
+        const std::shared_ptr<spdlog::logger>& glfw_logger = logging::static_logger<"glfw">();
 
         context.reset(new main_window_context());
         context->glf_window =
@@ -56,7 +56,7 @@ setup::main_window(const glfw_handle_t& glfw_handle, std::string_view name, size
     }
 
     {
-        std::shared_ptr<spdlog::logger> glad_logger = logging::get_logger("glad");
+        const std::shared_ptr<spdlog::logger>& glad_logger = logging::static_logger<"glad">();
 
         // Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
         const int version = gladLoadGL(glfwGetProcAddress);
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// store_sink backed by a file: the newest logs are restored by the next run, cold compression enabled or not.
+
+// project
+#include <utils/store_sink.hpp>
+#include <utils/thread_pool.hpp>
+
+// external
+#include <fmt/format.h>
+#include <spdlog/logger.h>
+
+// C++ standard
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace
+{
+    constexpr size_t CAPACITY_MB = 8;
+    constexpr uint64_t RECORDS = 100'000;
+    constexpr size_t PAYLOAD_SIZE = 200;
+    // records of the last segments fitting in the capacity
+    constexpr uint64_t FIRST_RESTORED = 78'630;
+
+    [[nodiscard]] std::filesystem::path store_path()
+    {
+        return std::filesystem::temp_directory_path() / "testgui_store_sink_test.store";
+    }
+
+    [[nodiscard]] std::string payload(uint64_t sequence)
+    {
+        std::string text = fmt::format("record {} ", sequence);
+        text.resize(PAYLOAD_SIZE, '.');
+        return text;
+    }
+
+    // before_sequence is called before logging the record sequence
+    template<typename Callable>
+    void log_burst(store_sink_mt& sink, Callable before_sequence)
+    {
+        spdlog::logger logger("test", sink.shared_from_this());
+        for(uint64_t i = 0; i < RECORDS; ++i)
+        {
+            before_sequence(i);
+            logger.info(payload(i));
+        }
+    }
+
+    void log_burst(store_sink_mt& sink)
+    {
+        log_burst(sink, [](uint64_t) {});
+    }
+
+    [[nodiscard]] bool check_restored(std::string_view name)
+    {
+        auto sink = std::make_shared<store_sink_mt>(CAPACITY_MB);
+        const tl::expected<size_t, std::string> restored = sink->open_file(store_path());
+        if(!restored)
+        {
+            fmt::print(stderr, "{}: failed to reopen the store: {}\n", name, restored.error());
+            return false;
+        }
+        const log_snapshot snapshot = sink->snapshot();
+        if(snapshot.begin_sequence() != FIRST_RESTORED || snapshot.end_sequence() != RECORDS)
+        {
+            fmt::print(stderr,
+                       "{}: restored [{}, {}), expected [{}, {})\n",
+                       name,
+                       snapshot.begin_sequence(),
+                       snapshot.end_sequence(),
+                       FIRST_RESTORED,
+                       RECORDS);
+            return false;
+        }
+        for(const uint64_t sequence: {FIRST_RESTORED, RECORDS - 1})
+        {
+            if(snapshot.at(sequence).payload != payload(sequence))
+            {
+                fmt::print(stderr, "{}: record {} restored with another payload\n", name, sequence);
+                return false;
+            }
+        }
+        fmt::print("{}: restored [{}, {})\n", name, snapshot.begin_sequence(), snapshot.end_sequence());
+        return true;
+    }
+
+    [[nodiscard]] bool check_uncompressed()
+    {
+        std::filesystem::remove(store_path());
+        {
+            auto sink = std::make_shared<store_sink_mt>(CAPACITY_MB);
+            if(!sink->open_file(store_path()))
+            {
+                fmt::print(stderr, "uncompressed: failed to open the store\n");
+                return false;
+            }
+            log_burst(*sink);
+        }
+        return check_restored("uncompressed");
+    }
+
+    // the compressions lag behind the burst, the evicted segments must give their slot back
+    [[nodiscard]] bool check_compressed_burst()
+    {
+        std::filesystem::remove(store_path());
+        thread_pool pool(8, thread_pool::scheduling::work_stealing, 2);
+        {
+            auto sink = std::make_shared<store_sink_mt>(CAPACITY_MB);
+            if(!sink->open_file(store_path()))
+            {
+                fmt::print(stderr, "compressed burst: failed to open the store\n");
+                return false;
+            }
+            sink->compress_cold_segments(&pool, 2);
+            log_burst(*sink);
+        }
+        // a compression still running holds its segment, and the file with it
+        pool.wait();
+        return check_restored("compressed burst");
+    }
+
+    // the evicted segments held by a snapshot keep their slot: the newest segments are saved once released
+    [[nodiscard]] bool check_held_snapshot()
+    {
+        std::filesystem::remove(store_path());
+        thread_pool pool(8, thread_pool::scheduling::work_stealing, 2);
+        {
+            auto sink = std::make_shared<store_sink_mt>(CAPACITY_MB);
+            if(!sink->open_file(store_path()))
+            {
+                fmt::print(stderr, "held snapshot: failed to open the store\n");
+                return false;
+            }
+            sink->compress_cold_segments(&pool, 2);
+            log_snapshot held;
+            log_burst(*sink,
+                      [&](uint64_t sequence)
+                      {
+                          if(sequence == RECORDS / 5)
+                          {
+                              held = sink->snapshot();
+                          }
+                      });
+            held = {};
+        }
+        pool.wait();
+        return check_restored("held snapshot");
+    }
+} // namespace
+
+int main()
+{
+    const bool uncompressed = check_uncompressed();
+    const bool compressed_burst = check_compressed_burst();
+    const bool held_snapshot = check_held_snapshot();
+    std::error_code error;
+    std::filesystem::remove(store_path(), error);
+    return uncompressed && compressed_burst && held_snapshot ? EXIT_SUCCESS : EXIT_FAILURE;
+}
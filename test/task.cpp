@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// task<T> coroutines: results, exceptions, nested awaits, moves between the pool and the UI thread.
+
+// project
+#include <utils/task.hpp>
+#include <utils/thread_pool.hpp>
+#include <utils/ui_dispatcher.hpp>
+
+// external
+#include <fmt/format.h>
+
+// C++ standard
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace
+{
+    [[nodiscard]] bool check(bool ok, std::string_view name)
+    {
+        if(!ok)
+        {
+            fmt::print(stderr, "{}: failed\n", name);
+        }
+        return ok;
+    }
+
+    // run the UI thread side until future is ready
+    template<typename T>
+    [[nodiscard]] T wait_draining(task_future<T>& future)
+    {
+        while(!future.ready())
+        {
+            [[maybe_unused]] const size_t ran = UI_DISPATCHER.drain(std::chrono::milliseconds(2));
+            std::this_thread::yield();
+        }
+        return future.get();
+    }
+
+// GCC 12 warns on the frame code it generates for every coroutine, at the closing brace
+#if defined(__GNUC__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wzero-as-null-pointer-constant"
+#endif
+
+    task<int> square_on(thread_pool& pool, int value)
+    {
+        co_await resume_on(pool);
+        co_return value * value;
+    }
+
+    task<int> sum_of_squares(thread_pool& pool, int count)
+    {
+        int sum = 0;
+        for(int i = 1; i <= count; ++i)
+        {
+            sum += co_await square_on(pool, i);
+        }
+        co_return sum;
+    }
+
+    task<int> immediate(int value)
+    {
+        co_return value;
+    }
+
+    // awaiting tasks completing synchronously continues inline: the stack doesn't grow, even without tail calls
+    task<int64_t> deep_chain(int count)
+    {
+        int64_t sum = 0;
+        for(int i = 0; i < count; ++i)
+        {
+            sum += co_await immediate(i);
+        }
+        co_return sum;
+    }
+
+    task<void> fail_on(thread_pool& pool)
+    {
+        co_await resume_on(pool, thread_pool::priority::background);
+        throw std::runtime_error("failed on the pool");
+    }
+
+    task<std::string> catch_failure(thread_pool& pool)
+    {
+        try
+        {
+            co_await fail_on(pool);
+        }
+        catch(const std::runtime_error& error)
+        {
+            co_return error.what();
+        }
+        co_return "no exception";
+    }
+
+    // pool -> UI thread -> pool, returns which hops ran on the expected thread
+    task<bool> hop_threads(thread_pool& pool, std::thread::id ui_thread_id)
+    {
+        co_await resume_on(pool);
+        const bool on_pool = std::this_thread::get_id() != ui_thread_id;
+        co_await ui_thread();
+        const bool on_ui = std::this_thread::get_id() == ui_thread_id;
+        co_await resume_on(pool, thread_pool::priority::interactive);
+        const bool back_on_pool = std::this_thread::get_id() != ui_thread_id;
+        co_return on_pool && on_ui && back_on_pool;
+    }
+
+#if defined(__GNUC__)
+#    pragma GCC diagnostic pop
+#endif
+} // namespace
+
+int main()
+{
+    thread_pool pool(2, thread_pool::scheduling::work_stealing, 1);
+    bool ok = true;
+
+    task_future<int> squares = spawn(sum_of_squares(pool, 10));
+    ok &= check(squares.get() == 385, "nested awaits on the pool");
+
+    task_future<int64_t> chain = spawn(deep_chain(1'000'000));
+    ok &= check(chain.get() == int64_t{999'999} * 1'000'000 / 2, "deep synchronous chain");
+
+    task_future<std::string> failure = spawn(catch_failure(pool));
+    ok &= check(failure.get() == "failed on the pool", "exception rethrown to the awaiting coroutine");
+
+    task_future<void> uncaught = spawn(fail_on(pool));
+    bool thrown = false;
+    try
+    {
+        uncaught.get();
+    }
+    catch(const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    ok &= check(thrown, "exception delivered through the spawned future");
+
+    task_future<bool> hops = spawn(hop_threads(pool, std::this_thread::get_id()));
+    ok &= check(wait_draining(hops), "resumed on the pool and the UI thread");
+
+    if(ok)
+    {
+        fmt::print("all task checks passed\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
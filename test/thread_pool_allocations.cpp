@@ -0,0 +1,179 @@
+//
+// Copyright (c) 2024 Maxime Pinard
+//
+// Distributed under the MIT license
+// See accompanying file LICENSE or copy at
+// https://opensource.org/licenses/MIT
+//
+
+// exec and submit of small callables don't allocate once the pool queues and the task states pool are warmed up.
+// A queue failing to grow runs the task on the calling thread.
+
+// project
+#include <utils/thread_pool.hpp>
+
+// external
+#include <fmt/format.h>
+
+// C++ standard
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::atomic<bool> counting = false;
+    std::atomic<size_t> allocations = 0;
+    std::atomic<bool> failing = false;
+
+    void* counted_alloc(size_t size, size_t alignment)
+    {
+        if(counting.load(std::memory_order_relaxed))
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(failing.load(std::memory_order_relaxed))
+        {
+            throw std::bad_alloc();
+        }
+        size = (size + alignment - 1) / alignment * alignment;
+        if(void* ptr = std::aligned_alloc(alignment, size == 0 ? alignment : size))
+        {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+
+    constexpr size_t WARM_UP_TASKS = 4096;
+    constexpr size_t COUNTED_TASKS = 1024;
+
+    // exec without and with arguments, submit, at every priority
+    [[nodiscard]] int run_tasks(thread_pool& pool, std::vector<task_future<int>>& futures, size_t count)
+    {
+        std::atomic<int> executed = 0;
+        for(size_t i = 0; i < count; ++i)
+        {
+            const auto lane = static_cast<thread_pool::priority>(i % thread_pool::PRIORITY_COUNT);
+            pool.exec(lane, [&executed]() noexcept { ++executed; });
+            pool.exec(lane, [&executed](int value) noexcept { executed += value; }, 1);
+            futures.push_back(pool.submit(lane, [value = static_cast<int>(i % 2)]() noexcept { return value; }));
+        }
+        pool.wait();
+        int total = executed;
+        for(task_future<int>& future: futures)
+        {
+            total += future.get();
+        }
+        futures.clear();
+        return total;
+    }
+
+    [[nodiscard]] bool check(thread_pool::scheduling mode, const char* name)
+    {
+        thread_pool pool(4, mode, 1);
+        std::vector<task_future<int>> futures;
+        futures.reserve(WARM_UP_TASKS);
+        [[maybe_unused]] const int warm_up = run_tasks(pool, futures, WARM_UP_TASKS);
+
+        allocations = 0;
+        counting = true;
+        const int total = run_tasks(pool, futures, COUNTED_TASKS);
+        counting = false;
+
+        const size_t expected_total = 2 * COUNTED_TASKS + COUNTED_TASKS / 2;
+        if(static_cast<size_t>(total) != expected_total)
+        {
+            fmt::print(stderr, "{}: {} tasks results, expected {}\n", name, total, expected_total);
+            return false;
+        }
+        if(allocations != 0)
+        {
+            fmt::print(stderr, "{}: {} allocations for {} tasks\n", name, allocations.load(), 3 * COUNTED_TASKS);
+            return false;
+        }
+        fmt::print("{}: no allocation for {} tasks\n", name, 3 * COUNTED_TASKS);
+        return true;
+    }
+
+    [[nodiscard]] bool check_out_of_memory()
+    {
+        static constexpr size_t TASKS = 1024;
+
+        thread_pool pool(1, thread_pool::scheduling::single_queue, 0);
+        std::atomic<bool> blocked = true;
+        pool.exec(
+          [&blocked]() noexcept
+          {
+              while(blocked)
+              {
+                  std::this_thread::yield();
+              }
+          });
+
+        // the only worker is busy, the queue has to grow past its initial capacity
+        std::atomic<size_t> executed = 0;
+        size_t executed_inline = 0;
+        failing = true;
+        for(size_t i = 0; i < TASKS; ++i)
+        {
+            pool.exec([&executed]() noexcept { ++executed; });
+            executed_inline = executed;
+        }
+        failing = false;
+        blocked = false;
+        pool.wait();
+
+        if(executed != TASKS || executed_inline == 0)
+        {
+            fmt::print(stderr,
+                       "out of memory: {} tasks run, {} on the caller, expected {}\n",
+                       executed.load(),
+                       executed_inline,
+                       TASKS);
+            return false;
+        }
+        fmt::print("out of memory: {} of {} tasks run by the caller\n", executed_inline, TASKS);
+        return true;
+    }
+} // namespace
+
+void* operator new(size_t size)
+{
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return counted_alloc(size, std::max(static_cast<size_t>(alignment), alignof(std::max_align_t)));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+int main()
+{
+    const bool single_queue = check(thread_pool::scheduling::single_queue, "single queue");
+    const bool work_stealing = check(thread_pool::scheduling::work_stealing, "work stealing");
+    const bool out_of_memory = check_out_of_memory();
+    return single_queue && work_stealing && out_of_memory ? EXIT_SUCCESS : EXIT_FAILURE;
+}